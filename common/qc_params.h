@@ -0,0 +1,128 @@
+// The parameters of the shader quasicrystal model, shared between the shader
+// viewer and the cpu engines that reproduce it.
+
+#ifndef QUASICRYSTAL_COMMON_QC_PARAMS_H
+#define QUASICRYSTAL_COMMON_QC_PARAMS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace quasicrystal {
+
+// Keep in sync with constant in qc.frag
+const int kMaxNumWaves = 15;
+
+// A sufficient set of parameters to describe any snapshot of the quasicrystals.
+struct QCParams {
+  QCParams()
+      : t(0.0),
+        num_waves(1),
+        mix(0.0),
+        angular_frequencies{1.0},
+        wavenumbers{0.2} {}
+  // Current time in the wave propagation.
+  float t;
+  // Number of waves.
+  int num_waves;
+  // Wave number mixing parameter, 0 = num_waves, 1 = num_waves + 1
+  float mix;
+  // Angular frequencies of each wave, individually specified.
+  float angular_frequencies[kMaxNumWaves];
+  // Spatial frequency of each wave, individually specified.
+  float wavenumbers[kMaxNumWaves];
+};
+
+// One of the plane waves summed for a frame, after mixing.
+struct MixedWave {
+  // Wave vector.
+  float kx, ky;
+  float angular_frequency;
+  // Weight in the sum, 0 to 1 for the wave being mixed in or out.
+  float weight;
+};
+
+// The number of waves summed for frames of params, counting the one being
+// mixed in or out.
+inline int NumMixedWaves(const QCParams& params) {
+  return std::min(params.num_waves + 1, kMaxNumWaves);
+}
+
+// Fill waves, which must have room for kMaxNumWaves, with the waves summed
+// for frames of params, independent of params.t.  Returns how many there
+// are.  This is the part of the model that is the same for every pixel.
+inline int MixWaves(const QCParams& params, MixedWave* waves) {
+  // The value of pi the shader model has always used.
+  const float kPi = 3.14159f;
+  const int n = params.num_waves;
+  const float mix = params.mix;
+  const int count = NumMixedWaves(params);
+  for (int w = 0; w < count; ++w) {
+    float angle = 0.0f;
+    float angular_frequency = params.angular_frequencies[0];
+    float wavenumber = params.wavenumbers[0];
+    if (w > 0) {
+      angle = (1.0f - mix) * (w - 1) * kPi / n + mix * w * kPi / (n + 1);
+      angular_frequency = (1.0f - mix) * params.angular_frequencies[w - 1] +
+                          mix * params.angular_frequencies[w];
+      wavenumber = (1.0f - mix) * params.wavenumbers[w - 1] +
+                   mix * params.wavenumbers[w];
+    }
+    waves[w].kx = wavenumber * std::cos(angle);
+    waves[w].ky = wavenumber * std::sin(angle);
+    waves[w].angular_frequency = angular_frequency;
+    // The wave at index 1 is the one being mixed in or out.
+    waves[w].weight = w == 1 ? mix : 1.0f;
+  }
+  return count;
+}
+
+// Returns sin(u) / u, with the removable singularity at 0 filled in.  The
+// box filters of antialiasing and motion blur attenuate waves by it.
+template <typename T>
+inline T Sinc(T u) {
+  return std::abs(u) < T(1e-4) ? T(1) : std::sin(u) / u;
+}
+
+// Split str on separator, as in the lists of values tools take.
+inline std::vector<std::string> Split(const std::string& str,
+                                      char separator) {
+  std::vector<std::string> parts;
+  std::stringstream ss(str);
+  std::string part;
+  while (std::getline(ss, part, separator)) {
+    parts.push_back(part);
+  }
+  return parts;
+}
+
+inline void SplitCommaSeparatedFloats(const std::string& str, float* v,
+                                      int size) {
+  std::stringstream ss(str);
+  std::string temp;
+  int i = 0;
+  while (std::getline(ss, temp, ',') && i < size) {
+    v[i] = atof(temp.c_str());
+    ++i;
+  }
+}
+
+// Build params from the comma separated forms used on the command line.
+inline QCParams ParseQCParams(int num_waves,
+                              const std::string& angular_frequencies,
+                              const std::string& wavenumbers) {
+  QCParams params;
+  params.num_waves = std::max(std::min(num_waves, kMaxNumWaves), 1);
+  SplitCommaSeparatedFloats(
+      angular_frequencies, params.angular_frequencies, kMaxNumWaves);
+  SplitCommaSeparatedFloats(
+      wavenumbers, params.wavenumbers, kMaxNumWaves);
+  return params;
+}
+
+}  // namespace quasicrystal
+
+#endif
@@ -0,0 +1,229 @@
+// Recorded sessions of the shader viewer, for reproducing performance
+// problems and as realistic benchmark workloads.  A session holds, for each
+// frame, the keys pressed before it and the parameters, view and shutter it
+// was drawn with.
+// Replaying the keys with the same fixed time step per frame reproduces the
+// parameters exactly, and renderers without a display can instead draw the
+// recorded parameters directly.
+//
+// Sessions are text files.  After a header line and the screen size, each
+// frame is a "frame" line followed by its keys, as X11 KeySyms, and then
+// only those parameters that changed since the frame before.  The view is
+// the field point at the screen center and the field units per pixel, as
+// qc.frag takes them, and the shutter is the time each wave is averaged
+// over for motion blur, or 0:
+//   quasicrystal-session 2
+//   size 600 600
+//   frame 0
+//   t 0.05
+//   waves 7
+//   ...
+//   view 0 0 1
+//   shutter 0
+//   frame 1
+//   key 93
+//   t 0.1
+//   mix 0.01
+// Version 1 sessions, from before the view and shutter were recorded, read
+// as drawn with view 0 0 1 and shutter 0.
+
+#ifndef QUASICRYSTAL_COMMON_SESSION_H
+#define QUASICRYSTAL_COMMON_SESSION_H
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/qc_params.h"
+
+namespace quasicrystal {
+
+struct SessionFrame {
+  SessionFrame()
+      : antialias(false),
+        view_x(0.0f),
+        view_y(0.0f),
+        view_scale(1.0f),
+        shutter(0.0f) {}
+  // Keys pressed since the frame before, in order.
+  std::vector<unsigned int> keys;
+  QCParams params;
+  bool antialias;
+  // The field point at the screen center, and field units per pixel.
+  float view_x, view_y, view_scale;
+  // Time each wave is averaged over before the frame, or 0 for none.
+  float shutter;
+};
+
+// Writes a session one frame at a time.
+class SessionWriter {
+ public:
+  SessionWriter() : file_(nullptr), num_frames_(0) {}
+  ~SessionWriter() {
+    if (file_ != nullptr) {
+      fclose(file_);
+    }
+  }
+
+  // Start a session of width x height frames at path.  Returns false if the
+  // file could not be created.
+  bool Open(const std::string& path, int width, int height) {
+    file_ = fopen(path.c_str(), "w");
+    if (file_ == nullptr) {
+      return false;
+    }
+    fprintf(file_, "quasicrystal-session 2\nsize %d %d\n", width, height);
+    return true;
+  }
+
+  // Record a key pressed before the next frame.
+  void AddKey(unsigned int key) {
+    keys_.push_back(key);
+  }
+
+  // Record a frame, whose keys are those added since the one before.
+  void AddFrame(const SessionFrame& frame) {
+    if (file_ == nullptr) {
+      return;
+    }
+    const bool first = num_frames_ == 0;
+    fprintf(file_, "frame %d\n", num_frames_++);
+    for (unsigned int key : keys_) {
+      fprintf(file_, "key %u\n", key);
+    }
+    keys_.clear();
+    const QCParams& params = frame.params;
+    // Enough digits that every float reads back exactly.
+    if (first || params.t != last_.params.t) {
+      fprintf(file_, "t %.9g\n", params.t);
+    }
+    if (first || params.num_waves != last_.params.num_waves) {
+      fprintf(file_, "waves %d\n", params.num_waves);
+    }
+    if (first || params.mix != last_.params.mix) {
+      fprintf(file_, "mix %.9g\n", params.mix);
+    }
+    if (first || frame.antialias != last_.antialias) {
+      fprintf(file_, "antialias %d\n", frame.antialias ? 1 : 0);
+    }
+    for (int i = 0; i < kMaxNumWaves; ++i) {
+      if (first || params.angular_frequencies[i] !=
+                   last_.params.angular_frequencies[i]) {
+        fprintf(file_, "af %d %.9g\n", i, params.angular_frequencies[i]);
+      }
+      if (first || params.wavenumbers[i] != last_.params.wavenumbers[i]) {
+        fprintf(file_, "wn %d %.9g\n", i, params.wavenumbers[i]);
+      }
+    }
+    if (first || frame.view_x != last_.view_x ||
+        frame.view_y != last_.view_y ||
+        frame.view_scale != last_.view_scale) {
+      fprintf(file_, "view %.9g %.9g %.9g\n", frame.view_x, frame.view_y,
+              frame.view_scale);
+    }
+    if (first || frame.shutter != last_.shutter) {
+      fprintf(file_, "shutter %.9g\n", frame.shutter);
+    }
+    last_ = frame;
+  }
+
+ private:
+  FILE* file_;
+  int num_frames_;
+  std::vector<unsigned int> keys_;
+  // The frame before, for writing only what changed.
+  SessionFrame last_;
+};
+
+// Whether a and b would draw the same frame.
+inline bool SameParams(const QCParams& a, const QCParams& b) {
+  if (a.t != b.t || a.num_waves != b.num_waves || a.mix != b.mix) {
+    return false;
+  }
+  for (int i = 0; i < kMaxNumWaves; ++i) {
+    if (a.angular_frequencies[i] != b.angular_frequencies[i] ||
+        a.wavenumbers[i] != b.wavenumbers[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether a and b would draw the same frame, whatever keys led to them.
+inline bool SameFrame(const SessionFrame& a, const SessionFrame& b) {
+  return SameParams(a.params, b.params) && a.antialias == b.antialias &&
+         a.view_x == b.view_x && a.view_y == b.view_y &&
+         a.view_scale == b.view_scale && a.shutter == b.shutter;
+}
+
+// Read a session written by SessionWriter.  Returns false if the file can
+// not be read or is not a session.
+inline bool ReadSession(const std::string& path, int* width, int* height,
+                        std::vector<SessionFrame>* frames) {
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line) || (line != "quasicrystal-session 1" &&
+                                  line != "quasicrystal-session 2")) {
+    return false;
+  }
+  frames->clear();
+  *width = *height = 0;
+  SessionFrame frame;
+  bool in_frame = false;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string field;
+    fields >> field;
+    bool ok = true;
+    if (field == "size") {
+      ok = static_cast<bool>(fields >> *width >> *height);
+    } else if (field == "frame") {
+      // Each frame starts from the parameters of the one before.
+      if (in_frame) {
+        frames->push_back(frame);
+      }
+      frame.keys.clear();
+      in_frame = true;
+    } else if (field == "key") {
+      unsigned int key;
+      ok = static_cast<bool>(fields >> key);
+      frame.keys.push_back(key);
+    } else if (field == "t") {
+      ok = static_cast<bool>(fields >> frame.params.t);
+    } else if (field == "waves") {
+      ok = static_cast<bool>(fields >> frame.params.num_waves);
+    } else if (field == "mix") {
+      ok = static_cast<bool>(fields >> frame.params.mix);
+    } else if (field == "antialias") {
+      ok = static_cast<bool>(fields >> frame.antialias);
+    } else if (field == "view") {
+      ok = static_cast<bool>(fields >> frame.view_x >> frame.view_y >>
+                             frame.view_scale);
+    } else if (field == "shutter") {
+      ok = static_cast<bool>(fields >> frame.shutter);
+    } else if (field == "af" || field == "wn") {
+      int i;
+      float value;
+      ok = fields >> i >> value && i >= 0 && i < kMaxNumWaves;
+      if (ok) {
+        (field == "af" ? frame.params.angular_frequencies :
+                         frame.params.wavenumbers)[i] = value;
+      }
+    } else {
+      ok = field.empty();
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  if (in_frame) {
+    frames->push_back(frame);
+  }
+  return *width > 0 && *height > 0;
+}
+
+}  // namespace quasicrystal
+
+#endif
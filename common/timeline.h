@@ -0,0 +1,261 @@
+// Timelines of keyframed parameters, for rendering choreographed animations
+// in batch rather than recording the viewer.  Each keyframe gives the
+// parameters at a moment of the animation, and frames between keyframes
+// interpolate them, including morphing between wave counts the way the
+// viewer's [ and ] keys do.
+//
+// Timelines are text files like sessions.  After a header line, the frame
+// size and rate are optional, and each keyframe is a "keyframe" line with
+// its time in seconds and how to get there from the keyframe before, step,
+// linear or smooth (the default is linear), followed by only those
+// parameters that change:
+//   quasicrystal-timeline 1
+//   size 1280 720
+//   fps 30
+//   keyframe 0
+//   waves 7
+//   speed 1
+//   keyframe 4 smooth
+//   waves 9
+//   wn 0 0.1
+//   keyframe 6
+//   speed 3
+//
+// The wave count may be fractional, as with "waves 7.5", which means the
+// 8th wave is half mixed in.  Rather than the time in the wave propagation,
+// keyframes give its speed, in time per second of animation, and the time
+// is its integral, so speed changes ease in and out with everything else.
+// A "t" line cuts to the given time at its keyframe instead.
+
+#ifndef QUASICRYSTAL_COMMON_TIMELINE_H
+#define QUASICRYSTAL_COMMON_TIMELINE_H
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common/qc_params.h"
+
+namespace quasicrystal {
+
+// How parameters get from one keyframe to the next.
+enum Interpolation {
+  // Hold the values of the keyframe before until the keyframe.
+  kStepInterpolation,
+  kLinearInterpolation,
+  // Ease in and out, with a smoothstep.
+  kSmoothInterpolation,
+};
+
+struct Keyframe {
+  Keyframe()
+      : time(0.0), interpolation(kLinearInterpolation), waves(1.0),
+        speed(1.0) {}
+  // Seconds from the start of the animation.
+  double time;
+  // How to get here from the keyframe before.
+  Interpolation interpolation;
+  // Parameters at the keyframe.  Of these, num_waves and mix are set from
+  // waves, and t from the speeds before, unless cut to.
+  QCParams params;
+  // Number of waves, with the fraction being mixed in.
+  double waves;
+  // Time in the wave propagation per second.
+  double speed;
+};
+
+struct Timeline {
+  Timeline() : width(0), height(0), fps(30.0) {}
+  // Frame size, or 0 if the timeline does not give one.
+  int width, height;
+  double fps;
+  // In order of time.
+  std::vector<Keyframe> keyframes;
+};
+
+namespace timeline_internal {
+
+// Fraction of the way from one keyframe to the next, at fraction u of the
+// time between them.
+inline double Ease(Interpolation interpolation, double u) {
+  switch (interpolation) {
+    case kStepInterpolation:
+      return u < 1.0 ? 0.0 : 1.0;
+    case kSmoothInterpolation:
+      return u * u * (3.0 - 2.0 * u);
+    default:
+      return u;
+  }
+}
+
+// The integral of Ease from 0 to u.
+inline double EaseIntegral(Interpolation interpolation, double u) {
+  switch (interpolation) {
+    case kStepInterpolation:
+      return 0.0;
+    case kSmoothInterpolation:
+      return u * u * u * (1.0 - 0.5 * u);
+    default:
+      return 0.5 * u * u;
+  }
+}
+
+inline double Mix(double a, double b, double f) {
+  return a + (b - a) * f;
+}
+
+// Set num_waves and mix from a fractional wave count.
+inline void SetWaves(double waves, QCParams* params) {
+  waves = std::max(1.0, std::min(waves, kMaxNumWaves - 1.0));
+  params->num_waves = static_cast<int>(std::floor(waves));
+  params->mix = static_cast<float>(waves - params->num_waves);
+}
+
+}  // namespace timeline_internal
+
+// The parameters at seconds into the timeline, which must have a keyframe.
+// Before the first keyframe and after the last the parameters are held,
+// apart from the time, which keeps going at the speed there.
+inline QCParams EvaluateTimeline(const Timeline& timeline, double seconds) {
+  using namespace timeline_internal;
+  const std::vector<Keyframe>& keyframes = timeline.keyframes;
+  const Keyframe* next = &keyframes.front();
+  for (const Keyframe& keyframe : keyframes) {
+    next = &keyframe;
+    if (keyframe.time > seconds) {
+      break;
+    }
+  }
+  if (next == &keyframes.front() || seconds >= next->time) {
+    QCParams params = next->params;
+    params.t += static_cast<float>(next->speed * (seconds - next->time));
+    return params;
+  }
+  const Keyframe& previous = *(next - 1);
+  const double duration = next->time - previous.time;
+  const double u = (seconds - previous.time) / duration;
+  const double f = Ease(next->interpolation, u);
+  QCParams params;
+  for (int i = 0; i < kMaxNumWaves; ++i) {
+    params.angular_frequencies[i] = static_cast<float>(Mix(
+        previous.params.angular_frequencies[i],
+        next->params.angular_frequencies[i], f));
+    params.wavenumbers[i] = static_cast<float>(Mix(
+        previous.params.wavenumbers[i], next->params.wavenumbers[i], f));
+  }
+  SetWaves(Mix(previous.waves, next->waves, f), &params);
+  params.t = static_cast<float>(
+      previous.params.t +
+      duration * (previous.speed * u +
+                  (next->speed - previous.speed) *
+                      EaseIntegral(next->interpolation, u)));
+  return params;
+}
+
+// The number of frames in the timeline, from time 0 to its last keyframe.
+inline int NumTimelineFrames(const Timeline& timeline) {
+  if (timeline.keyframes.empty()) {
+    return 0;
+  }
+  return static_cast<int>(
+      std::floor(timeline.keyframes.back().time * timeline.fps + 1e-6)) + 1;
+}
+
+// Read a timeline, with the parameters before its first keyframe starting
+// from initial.  Returns false if the file can not be read or is not a
+// timeline.
+inline bool ReadTimeline(const std::string& path, const QCParams& initial,
+                         Timeline* timeline) {
+  using namespace timeline_internal;
+  std::ifstream in(path);
+  std::string line;
+  if (!std::getline(in, line) || line != "quasicrystal-timeline 1") {
+    return false;
+  }
+  *timeline = Timeline();
+  Keyframe keyframe;
+  keyframe.params = initial;
+  keyframe.waves = initial.num_waves + initial.mix;
+  bool in_keyframe = false;
+  // Whether the current keyframe cuts to a time of its own.
+  bool cut = false;
+  std::vector<bool> cuts;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string field;
+    fields >> field;
+    bool ok = true;
+    if (field == "size") {
+      ok = static_cast<bool>(fields >> timeline->width >> timeline->height);
+    } else if (field == "fps") {
+      ok = fields >> timeline->fps && timeline->fps > 0.0;
+    } else if (field == "keyframe") {
+      // Each keyframe starts from the parameters of the one before.
+      if (in_keyframe) {
+        timeline->keyframes.push_back(keyframe);
+        cuts.push_back(cut);
+      }
+      std::string interpolation = "linear";
+      ok = static_cast<bool>(fields >> keyframe.time);
+      fields >> interpolation;
+      if (interpolation == "step") {
+        keyframe.interpolation = kStepInterpolation;
+      } else if (interpolation == "smooth") {
+        keyframe.interpolation = kSmoothInterpolation;
+      } else {
+        keyframe.interpolation = kLinearInterpolation;
+        ok = ok && interpolation == "linear";
+      }
+      ok = ok && (timeline->keyframes.empty() ||
+                  keyframe.time > timeline->keyframes.back().time);
+      in_keyframe = true;
+      cut = false;
+    } else if (field == "waves") {
+      ok = static_cast<bool>(fields >> keyframe.waves);
+    } else if (field == "speed") {
+      ok = static_cast<bool>(fields >> keyframe.speed);
+    } else if (field == "t") {
+      ok = static_cast<bool>(fields >> keyframe.params.t);
+      cut = true;
+    } else if (field == "af" || field == "wn") {
+      int i;
+      float value;
+      ok = fields >> i >> value && i >= 0 && i < kMaxNumWaves;
+      if (ok) {
+        (field == "af" ? keyframe.params.angular_frequencies :
+                         keyframe.params.wavenumbers)[i] = value;
+      }
+    } else {
+      ok = field.empty() || field[0] == '#';
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  if (in_keyframe) {
+    timeline->keyframes.push_back(keyframe);
+    cuts.push_back(cut);
+  }
+  // Fill in what each keyframe implies.
+  std::vector<Keyframe>& keyframes = timeline->keyframes;
+  for (size_t k = 0; k < keyframes.size(); ++k) {
+    SetWaves(keyframes[k].waves, &keyframes[k].params);
+    if (k > 0 && !cuts[k]) {
+      const Keyframe& previous = keyframes[k - 1];
+      const double duration = keyframes[k].time - previous.time;
+      keyframes[k].params.t = static_cast<float>(
+          previous.params.t +
+          duration * (previous.speed +
+                      (keyframes[k].speed - previous.speed) *
+                          EaseIntegral(keyframes[k].interpolation, 1.0)));
+    }
+  }
+  return !keyframes.empty();
+}
+
+}  // namespace quasicrystal
+
+#endif
@@ -0,0 +1,212 @@
+// A lightweight tracer of scoped spans, written out as Chrome trace event
+// JSON that chrome://tracing and Perfetto can load, to see per thread when
+// each part of a frame happened.
+//
+// Every thread appends its spans to its own buffer, a list of fixed size
+// chunks that only it writes to, so recording takes no locks.  Nothing is
+// recorded until Start is called, and each span then costs two clock reads.
+// Buffers are only read by WriteJson, typically once at exit, and outlive
+// their threads, so pool and OpenMP workers show up too.
+//
+// Example:
+//   trace::Start();
+//   trace::SetThreadName("ui");
+//   {
+//     TRACE_SPAN("Draw");
+//     Draw();
+//   }
+//   trace::WriteJson("session.json");
+
+#ifndef QUASICRYSTAL_COMMON_TRACE_H
+#define QUASICRYSTAL_COMMON_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace quasicrystal {
+namespace trace {
+
+// Spans per chunk of a thread's buffer.
+const int kChunkSpans = 4096;
+
+// One span.  Names must outlive the tracer, as string literals do.
+struct Span {
+  const char* name;
+  // Nanoseconds since Start.
+  int64_t start_ns;
+  int64_t duration_ns;
+};
+
+struct Chunk {
+  Chunk() : count(0), next(nullptr) {}
+  Span spans[kChunkSpans];
+  // Spans written so far, published to readers with release stores.
+  std::atomic<int> count;
+  std::atomic<Chunk*> next;
+};
+
+// The spans of one thread.
+struct ThreadBuffer {
+  explicit ThreadBuffer(int id)
+      : id(id), name(nullptr), first(new Chunk), last(first) {}
+  int id;
+  // Set once, by the owning thread, before it records anything.
+  std::atomic<const char*> name;
+  Chunk* first;
+  // Only used by the owning thread.
+  Chunk* last;
+};
+
+// Global state, shared by all threads.
+struct Tracer {
+  Tracer() : enabled(false), started(false) {}
+  std::atomic<bool> enabled;
+  // Set once, before enabled is first set.
+  bool started;
+  std::chrono::steady_clock::time_point start;
+  // Guards buffers, which only grows.
+  std::mutex mutex;
+  std::vector<ThreadBuffer*> buffers;
+};
+
+inline Tracer& GlobalTracer() {
+  static Tracer tracer;
+  return tracer;
+}
+
+inline bool Enabled() {
+  return GlobalTracer().enabled.load(std::memory_order_acquire);
+}
+
+// Nanoseconds since Start.
+inline int64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - GlobalTracer().start).count();
+}
+
+// The calling thread's buffer, registered on first use.
+inline ThreadBuffer* CurrentBuffer() {
+  static thread_local ThreadBuffer* buffer = nullptr;
+  if (buffer == nullptr) {
+    Tracer& tracer = GlobalTracer();
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    buffer = new ThreadBuffer(static_cast<int>(tracer.buffers.size()) + 1);
+    tracer.buffers.push_back(buffer);
+  }
+  return buffer;
+}
+
+// Start recording.  Times are relative to the first call.
+inline void Start() {
+  Tracer& tracer = GlobalTracer();
+  {
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    if (!tracer.started) {
+      tracer.start = std::chrono::steady_clock::now();
+      tracer.started = true;
+    }
+  }
+  tracer.enabled = true;
+}
+
+// Name the calling thread in the trace.  name must outlive the tracer.
+inline void SetThreadName(const char* name) {
+  if (Enabled()) {
+    CurrentBuffer()->name.store(name, std::memory_order_release);
+  }
+}
+
+// Append a span to the calling thread's buffer.
+inline void Record(const char* name, int64_t start_ns, int64_t end_ns) {
+  ThreadBuffer* buffer = CurrentBuffer();
+  Chunk* chunk = buffer->last;
+  int count = chunk->count.load(std::memory_order_relaxed);
+  if (count == kChunkSpans) {
+    Chunk* next = new Chunk;
+    chunk->next.store(next, std::memory_order_release);
+    buffer->last = chunk = next;
+    count = 0;
+  }
+  Span& span = chunk->spans[count];
+  span.name = name;
+  span.start_ns = start_ns;
+  span.duration_ns = end_ns - start_ns;
+  chunk->count.store(count + 1, std::memory_order_release);
+}
+
+// Records the lifetime of the scope it is declared in, if tracing was on
+// when it began.
+class ScopedSpan {
+ public:
+  explicit ScopedSpan(const char* name)
+      : name_(name), start_ns_(Enabled() ? Now() : -1) {}
+  ~ScopedSpan() {
+    if (start_ns_ >= 0) {
+      Record(name_, start_ns_, Now());
+    }
+  }
+
+ private:
+  const char* name_;
+  int64_t start_ns_;
+};
+
+// Write every span recorded so far to path as trace event JSON.  May be
+// called while other threads are still recording; their newest spans may
+// be left out.  Returns false if the file could not be written.
+inline bool WriteJson(const std::string& path) {
+  Tracer& tracer = GlobalTracer();
+  std::vector<ThreadBuffer*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    buffers = tracer.buffers;
+  }
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  const char* separator = "";
+  for (const ThreadBuffer* buffer : buffers) {
+    const char* name = buffer->name.load(std::memory_order_acquire);
+    if (name != nullptr) {
+      fprintf(file,
+              "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+              "\"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+              separator, buffer->id, name);
+      separator = ",\n";
+    }
+    for (const Chunk* chunk = buffer->first; chunk != nullptr;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+      const int count = chunk->count.load(std::memory_order_acquire);
+      for (int i = 0; i < count; ++i) {
+        const Span& span = chunk->spans[i];
+        fprintf(file,
+                "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                separator, span.name, buffer->id, 1e-3 * span.start_ns,
+                1e-3 * span.duration_ns);
+        separator = ",\n";
+      }
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+}  // namespace trace
+}  // namespace quasicrystal
+
+#define TRACE_SPAN_NAME2(line) trace_span_##line
+#define TRACE_SPAN_NAME(line) TRACE_SPAN_NAME2(line)
+
+// Record a span named name, a string literal, for the rest of the scope.
+#define TRACE_SPAN(name) \
+  ::quasicrystal::trace::ScopedSpan TRACE_SPAN_NAME(__LINE__)(name)
+
+#endif
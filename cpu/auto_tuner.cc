@@ -0,0 +1,204 @@
+#include "auto_tuner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "worker_pool.h"
+
+namespace quasicrystal {
+
+namespace {
+
+// A trial is abandoned after its untimed frame if that took this many times
+// longer than the best frame so far.
+const double kPruneFactor = 4.0;
+
+// A configuration only replaces the best so far if it is faster by this
+// fraction, so that timing noise does not move the choice away from the
+// defaults, which are tried first.
+const double kMinImprovement = 0.02;
+
+// Band heights to try, besides the kernel's default.
+const int kBandHeights[] = {4, 8, 16, 32, 64, 128, 256};
+
+const char* const kColorNames[] = {"gray", "rotor"};
+const char* const kSymmetryNames[] = {"none", "mirror", "full"};
+
+// Time frames with configuration, setting configuration->frame_ms, and
+// keep it in best if it is enough of an improvement.  Frames are rendered
+// at successive times from *t, so nothing is reused across them.
+void Trial(const WaveTable& waves, const RenderParams& params, int width,
+           int height, const TuneOptions& options,
+           TunedConfiguration configuration, float* t,
+           TunedConfiguration* best,
+           std::vector<TunedConfiguration>* trials) {
+  RenderParams trial_params = params;
+  trial_params.kernel = configuration.kernel;
+  trial_params.band_height = configuration.band_height;
+  const Renderer renderer(waves, trial_params);
+  const Viewport viewport(0, 0, width, height);
+  std::vector<float> out(width * height * renderer.channels());
+  WorkerPool pool(configuration.threads);
+
+  typedef std::chrono::duration<double, std::milli> Milliseconds;
+  const auto start = std::chrono::steady_clock::now();
+  renderer.Render((*t)++, viewport, out.data(), &pool);
+  double elapsed = Milliseconds(std::chrono::steady_clock::now() - start)
+                       .count();
+  configuration.frame_ms = INFINITY;
+  if (elapsed <= kPruneFactor * best->frame_ms) {
+    double total = 0.0;
+    for (int frame = 0;
+         frame < options.min_frames || total < 1e3 * options.trial_seconds;
+         ++frame) {
+      const auto frame_start = std::chrono::steady_clock::now();
+      renderer.Render((*t)++, viewport, out.data(), &pool);
+      elapsed = Milliseconds(std::chrono::steady_clock::now() - frame_start)
+                    .count();
+      configuration.frame_ms = std::min(configuration.frame_ms, elapsed);
+      total += elapsed;
+    }
+  }
+  if (trials != nullptr) {
+    trials->push_back(configuration);
+  }
+  if (configuration.frame_ms < (1.0 - kMinImprovement) * best->frame_ms) {
+    *best = configuration;
+  }
+}
+
+}  // namespace
+
+TunedConfiguration AutoTune(const WaveTable& waves, const RenderParams& params,
+                            int width, int height, const TuneOptions& options,
+                            std::vector<TunedConfiguration>* trials) {
+  int max_threads = options.max_threads;
+  if (max_threads <= 0) {
+    max_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  float t = 1.0f;
+  TunedConfiguration best;
+  best.frame_ms = INFINITY;
+
+  // Kernels on all threads, starting from the usual choice.
+  TunedConfiguration configuration;
+  configuration.threads = max_threads;
+  std::vector<Kernel> kernels(1, ChooseKernel(waves.size()));
+  for (int k = kDirectKernel; k <= kSeparableKernel; ++k) {
+    if (k != kernels[0]) {
+      kernels.push_back(static_cast<Kernel>(k));
+    }
+  }
+  for (Kernel kernel : kernels) {
+    configuration.kernel = kernel;
+    Trial(waves, params, width, height, options, configuration, &t, &best,
+          trials);
+  }
+
+  // Band heights for the best kernel.  Bands taller than the frame are all
+  // the same.
+  configuration = best;
+  for (int band_height : kBandHeights) {
+    if (band_height < height) {
+      configuration.band_height = band_height;
+      Trial(waves, params, width, height, options, configuration, &t, &best,
+            trials);
+    }
+  }
+
+  // Fewer threads, in case some are hyperthreads or busy.
+  configuration = best;
+  for (int threads = 1; threads < max_threads; threads *= 2) {
+    configuration.threads = threads;
+    Trial(waves, params, width, height, options, configuration, &t, &best,
+          trials);
+  }
+  return best;
+}
+
+std::string CpuModel() {
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.compare(0, 10, "model name") == 0) {
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos) {
+        return line.substr(line.find_first_not_of(' ', colon + 1));
+      }
+    }
+  }
+  return "unknown";
+}
+
+TuneCache::TuneCache(const std::string& path) : path_(path) {
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    const size_t tab = line.find('\t');
+    if (tab == std::string::npos) {
+      continue;
+    }
+    std::istringstream fields(line.substr(tab + 1));
+    std::string kernel;
+    TunedConfiguration configuration;
+    if (fields >> kernel >> configuration.band_height >>
+            configuration.threads >> configuration.frame_ms &&
+        ParseKernel(kernel, &configuration.kernel)) {
+      entries_[line.substr(0, tab)] = configuration;
+    }
+  }
+}
+
+std::string TuneCache::DefaultPath() {
+  const char* home = getenv("HOME");
+  return home != nullptr ? std::string(home) + "/.quasicrystal_tune" :
+                           ".quasicrystal_tune";
+}
+
+std::string TuneCache::Key(const WaveTable& waves, const RenderParams& params,
+                           int width, int height) {
+  std::ostringstream key;
+  key << CpuModel() << "/" << std::thread::hardware_concurrency() << "t/"
+      << width << "x" << height << "/" << waves.size() << "w/"
+      << kColorNames[params.color] << "/"
+      << (params.antialias ? "antialias" : "point") << "/"
+      << kSymmetryNames[params.symmetry];
+  return key.str();
+}
+
+bool TuneCache::Lookup(const std::string& key,
+                       TunedConfiguration* configuration) const {
+  auto entry = entries_.find(key);
+  if (entry == entries_.end()) {
+    return false;
+  }
+  *configuration = entry->second;
+  return true;
+}
+
+bool TuneCache::Store(const std::string& key,
+                      const TunedConfiguration& configuration) {
+  entries_[key] = configuration;
+  // Write a new file and move it into place, so that a run that starts
+  // meanwhile never reads half a cache.
+  const std::string temporary_path = path_ + ".tmp";
+  FILE* file = fopen(temporary_path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  for (const auto& entry : entries_) {
+    fprintf(file, "%s\t%s\t%d\t%d\t%.4f\n", entry.first.c_str(),
+            KernelName(entry.second.kernel), entry.second.band_height,
+            entry.second.threads, entry.second.frame_ms);
+  }
+  const bool written = fclose(file) == 0;
+  return written && rename(temporary_path.c_str(), path_.c_str()) == 0;
+}
+
+}  // namespace quasicrystal
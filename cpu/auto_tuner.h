@@ -0,0 +1,99 @@
+// Picks the fastest kernel, band height and thread count for rendering one
+// kind of frame on this machine, by timing short trials of each.  The best
+// configuration differs a lot between machines, so results are kept in a
+// TuneCache keyed by the processor and the problem, and later runs can
+// start from the cached configuration without timing anything.
+//
+// Example:
+//   TuneCache cache(TuneCache::DefaultPath());
+//   const std::string key = TuneCache::Key(waves, params, width, height);
+//   TunedConfiguration tuned;
+//   if (!cache.Lookup(key, &tuned)) {
+//     tuned = AutoTune(waves, params, width, height, TuneOptions(), nullptr);
+//     cache.Store(key, tuned);
+//   }
+//   params.kernel = tuned.kernel;
+//   params.band_height = tuned.band_height;
+//   WorkerPool pool(tuned.threads);
+
+#ifndef QUASICRYSTAL_AUTO_TUNER_H
+#define QUASICRYSTAL_AUTO_TUNER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "renderer.h"
+#include "wave_kernels.h"
+#include "wave_table.h"
+
+namespace quasicrystal {
+
+struct TunedConfiguration {
+  TunedConfiguration()
+      : kernel(kSimdKernel), band_height(0), threads(1), frame_ms(0.0) {}
+  Kernel kernel;
+  // As in RenderParams, 0 for the kernel's default.
+  int band_height;
+  // Worker threads to render on.
+  int threads;
+  // Fastest frame time in the trial, or infinity if the trial was cut
+  // short for being much slower than the best so far.
+  double frame_ms;
+};
+
+struct TuneOptions {
+  TuneOptions() : trial_seconds(0.05), min_frames(2), max_threads(0) {}
+  // Frames are timed for at least this long in each trial...
+  double trial_seconds;
+  // ... and at least this many frames, after one untimed frame.
+  int min_frames;
+  // Most threads to try, or 0 for one per hardware thread.
+  int max_threads;
+};
+
+// Time frames of waves over a width x height viewport and return the
+// fastest configuration.  params holds the settings that are not tuned,
+// like the color mode; its kernel and band height are ignored.  Rather than
+// every combination, this tunes the kernel on all threads, then the band
+// height for that kernel, then the thread count, so it runs a few dozen
+// trials at most.  If trials is not null, it receives every trial in order.
+TunedConfiguration AutoTune(const WaveTable& waves, const RenderParams& params,
+                            int width, int height, const TuneOptions& options,
+                            std::vector<TunedConfiguration>* trials);
+
+// The model name of the first processor, or "unknown".
+std::string CpuModel();
+
+// Tuned configurations in a text file, one per line.  Lines are a key and
+// the kernel, band height, thread count and frame time, separated by tabs.
+class TuneCache {
+ public:
+  // Loads the cache at path, which need not exist yet.
+  explicit TuneCache(const std::string& path);
+
+  // ~/.quasicrystal_tune, or .quasicrystal_tune without a home directory.
+  static std::string DefaultPath();
+
+  // The key of a problem on this machine: the processor model, hardware
+  // thread count, frame size, and the number of waves and untuned render
+  // settings.
+  static std::string Key(const WaveTable& waves, const RenderParams& params,
+                         int width, int height);
+
+  // Returns true and fills configuration if key is in the cache.
+  bool Lookup(const std::string& key,
+              TunedConfiguration* configuration) const;
+
+  // Add or replace the entry for key and rewrite the file.  Returns false if
+  // the file could not be written.
+  bool Store(const std::string& key, const TunedConfiguration& configuration);
+
+ private:
+  std::string path_;
+  std::map<std::string, TunedConfiguration> entries_;
+};
+
+}  // namespace quasicrystal
+
+#endif
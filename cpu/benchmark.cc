@@ -0,0 +1,377 @@
+// Benchmark suite for the cpu renderer.  Times every combination of the
+// given resolutions, wave counts, thread counts and kernels, and reports
+// for each the spread of frame times over a number of repetitions after
+// warming up, the time per pixel per wave, frames per second, and how well
+// it scales compared to one thread.
+//
+// With --profile, one more frame of each configuration is rendered with
+// hardware counters, and its instructions per cycle, memory traffic per
+// pixel and thread imbalance are reported as well.
+//
+// Results can be written as JSON and compared against an earlier run, in
+// which case any configuration that got slower by more than --tolerance is
+// flagged and the exit status is nonzero.
+//
+// Usage:
+//   ./benchmark --json=before.json
+//   ./benchmark --baseline=before.json --json=after.json
+//   ./benchmark --resolutions=1920x1920 --wave_counts=7 --threads=1,2,4,8
+//       --kernels=simd,recurrence
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "common/qc_params.h"
+#include "auto_tuner.h"
+#include "profile.h"
+#include "renderer.h"
+#include "wave_kernels.h"
+#include "wave_table.h"
+#include "worker_pool.h"
+
+DEFINE_string(resolutions, "640x480,1920x1920",
+              "Comma separated frame sizes, as WIDTHxHEIGHT.");
+DEFINE_string(wave_counts, "7,15,64", "Comma separated numbers of waves.");
+DEFINE_string(threads, "1,0",
+              "Comma separated worker thread counts, 0 for one per hardware "
+              "thread.");
+DEFINE_string(kernels, "simd,recurrence,nufft",
+              "Comma separated kernels: direct, simd, recurrence, nufft, "
+              "separable.");
+DEFINE_double(freq, 1.0 / 5.0, "Frequency of waves.");
+DEFINE_int32(warmup, 2, "Untimed frames before each measurement.");
+DEFINE_int32(repetitions, 7, "Timed frames per measurement.");
+DEFINE_string(json, "", "If set, write the results to this file.");
+DEFINE_string(baseline, "",
+              "If set, compare against the results in this file, as written "
+              "by --json.");
+DEFINE_double(tolerance, 0.1,
+              "Fraction by which a median frame time may exceed the "
+              "baseline before it counts as a regression.");
+DEFINE_bool(profile, false,
+            "Also profile one frame of each configuration with hardware "
+            "counters.");
+
+using namespace quasicrystal;
+
+namespace {
+
+struct Configuration {
+  Kernel kernel;
+  int width, height;
+  int num_waves;
+  int threads;
+};
+
+struct Result {
+  Configuration configuration;
+  std::string name;
+  // Frame times in milliseconds.
+  double min_ms, median_ms, mean_ms, stddev_ms;
+  double ns_per_pixel_wave;
+  double fps;
+  // Time on one thread over time on threads threads, per thread, or
+  // negative if there is no one thread result to compare with.
+  double scaling_efficiency;
+  // Median over the baseline median, or negative if there is none.
+  double baseline_ratio;
+  // From the profiled frame with --profile, where the counters are
+  // available, or negative.
+  double ipc, bytes_per_pixel;
+  // From the profiled frame with --profile, or negative.
+  double imbalance;
+};
+
+std::string ResultName(const Configuration& configuration) {
+  std::ostringstream name;
+  name << KernelName(configuration.kernel) << "/" << configuration.width
+       << "x" << configuration.height << "/" << configuration.num_waves
+       << "w/" << configuration.threads << "t";
+  return name.str();
+}
+
+// Time one configuration on the pool.
+Result Measure(const Configuration& configuration, WorkerPool* pool) {
+  RenderParams params;
+  params.kernel = configuration.kernel;
+  Renderer renderer(MakeCrystalWaves(configuration.num_waves,
+                                     static_cast<float>(FLAGS_freq)),
+                    params);
+  const Viewport viewport(0, 0, configuration.width, configuration.height);
+  std::vector<float> out(configuration.width * configuration.height);
+
+  // Each frame is at a new time, so that nothing can be reused across them.
+  int step = 0;
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    renderer.Render(step++, viewport, out.data(), pool);
+  }
+  std::vector<double> times;
+  for (int i = 0; i < FLAGS_repetitions; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    renderer.Render(step++, viewport, out.data(), pool);
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    times.push_back(elapsed.count());
+  }
+
+  Result result;
+  result.configuration = configuration;
+  result.name = ResultName(configuration);
+  std::sort(times.begin(), times.end());
+  const int n = static_cast<int>(times.size());
+  result.min_ms = times[0];
+  result.median_ms = n % 2 ? times[n / 2] :
+                     0.5 * (times[n / 2 - 1] + times[n / 2]);
+  result.mean_ms = 0.0;
+  for (double time : times) {
+    result.mean_ms += time / n;
+  }
+  result.stddev_ms = 0.0;
+  for (double time : times) {
+    result.stddev_ms += (time - result.mean_ms) * (time - result.mean_ms);
+  }
+  result.stddev_ms = n > 1 ? std::sqrt(result.stddev_ms / (n - 1)) : 0.0;
+  result.ns_per_pixel_wave =
+      1e6 * result.median_ms /
+      (static_cast<double>(configuration.width) * configuration.height *
+       configuration.num_waves);
+  result.fps = 1e3 / result.median_ms;
+  result.scaling_efficiency = -1.0;
+  result.baseline_ratio = -1.0;
+  result.ipc = result.bytes_per_pixel = result.imbalance = -1.0;
+  if (FLAGS_profile) {
+    // Separately from the timed frames, which should not pay for reading
+    // the counters.
+    FrameProfile profile;
+    renderer.Render(step++, viewport, out.data(), pool, Exposure(), nullptr,
+                    &profile);
+    if (profile.counters_available()) {
+      result.ipc = profile.ipc();
+      result.bytes_per_pixel = profile.bytes_per_pixel();
+    }
+    result.imbalance = profile.imbalance();
+  }
+  return result;
+}
+
+// Read the median frame times of each result in a file written by
+// WriteJson, which has one result per line.
+bool ReadBaseline(const std::string& filename,
+                  std::map<std::string, double>* medians) {
+  std::ifstream in(filename);
+  if (!in) {
+    return false;
+  }
+  const std::string name_key = "\"name\": \"";
+  const std::string median_key = "\"median_ms\": ";
+  std::string line;
+  while (std::getline(in, line)) {
+    const size_t name = line.find(name_key);
+    const size_t median = line.find(median_key);
+    if (name == std::string::npos || median == std::string::npos) {
+      continue;
+    }
+    const size_t begin = name + name_key.size();
+    const size_t end = line.find('"', begin);
+    (*medians)[line.substr(begin, end - begin)] =
+        atof(line.c_str() + median + median_key.size());
+  }
+  return true;
+}
+
+// Write "key": value followed by suffix, with negative values as null.
+void JsonNumber(FILE* file, const char* key, double value,
+                const char* suffix) {
+  if (value >= 0.0) {
+    fprintf(file, "\"%s\": %.4f%s", key, value, suffix);
+  } else {
+    fprintf(file, "\"%s\": null%s", key, suffix);
+  }
+}
+
+bool WriteJson(const std::string& filename,
+               const std::vector<Result>& results) {
+  FILE* file = fopen(filename.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "{\n");
+  fprintf(file, "  \"cpu\": \"%s\",\n", CpuModel().c_str());
+  fprintf(file, "  \"hardware_threads\": %u,\n",
+          std::thread::hardware_concurrency());
+  fprintf(file, "  \"warmup\": %d,\n", FLAGS_warmup);
+  fprintf(file, "  \"repetitions\": %d,\n", FLAGS_repetitions);
+  fprintf(file, "  \"results\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"kernel\": \"%s\", \"width\": %d, "
+            "\"height\": %d, \"waves\": %d, \"threads\": %d, "
+            "\"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, "
+            "\"stddev_ms\": %.4f, \"ns_per_pixel_wave\": %.5f, "
+            "\"fps\": %.3f, ",
+            r.name.c_str(), KernelName(r.configuration.kernel),
+            r.configuration.width, r.configuration.height,
+            r.configuration.num_waves, r.configuration.threads, r.min_ms,
+            r.median_ms, r.mean_ms, r.stddev_ms, r.ns_per_pixel_wave, r.fps);
+    if (FLAGS_profile) {
+      JsonNumber(file, "ipc", r.ipc, ", ");
+      JsonNumber(file, "bytes_per_pixel", r.bytes_per_pixel, ", ");
+      JsonNumber(file, "imbalance", r.imbalance, ", ");
+    }
+    JsonNumber(file, "scaling_efficiency", r.scaling_efficiency, "}");
+    fprintf(file, "%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  return fclose(file) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_repetitions < 1) {
+    printf("--repetitions must be positive\n");
+    return 1;
+  }
+
+  std::vector<Kernel> kernels;
+  for (const std::string& name : Split(FLAGS_kernels, ',')) {
+    Kernel kernel;
+    if (!ParseKernel(name, &kernel)) {
+      printf("Unknown kernel %s\n", name.c_str());
+      return 1;
+    }
+    kernels.push_back(kernel);
+  }
+  std::vector<std::pair<int, int>> resolutions;
+  for (const std::string& resolution : Split(FLAGS_resolutions, ',')) {
+    int width, height;
+    if (sscanf(resolution.c_str(), "%dx%d", &width, &height) != 2 ||
+        width <= 0 || height <= 0) {
+      printf("Bad resolution %s\n", resolution.c_str());
+      return 1;
+    }
+    resolutions.push_back(std::make_pair(width, height));
+  }
+  std::vector<int> wave_counts;
+  for (const std::string& count : Split(FLAGS_wave_counts, ',')) {
+    wave_counts.push_back(atoi(count.c_str()));
+  }
+  // Resolve 0 to the hardware, and drop repeats that it may cause.  One
+  // thread goes first, as the reference for scaling.
+  std::vector<int> thread_counts;
+  for (const std::string& count : Split(FLAGS_threads, ',')) {
+    int threads = atoi(count.c_str());
+    if (threads <= 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (std::find(thread_counts.begin(), thread_counts.end(), threads) ==
+        thread_counts.end()) {
+      thread_counts.push_back(threads);
+    }
+  }
+  std::sort(thread_counts.begin(), thread_counts.end());
+
+  std::map<std::string, double> baseline;
+  if (!FLAGS_baseline.empty() && !ReadBaseline(FLAGS_baseline, &baseline)) {
+    printf("Failed to read %s\n", FLAGS_baseline.c_str());
+    return 1;
+  }
+
+  printf("%s, %u hardware threads, %d warmup, %d repetitions\n",
+         CpuModel().c_str(), std::thread::hardware_concurrency(),
+         FLAGS_warmup, FLAGS_repetitions);
+  printf("%-30s %10s %8s %10s %9s %6s %9s", "configuration", "median ms",
+         "stddev", "ns/px/wave", "fps", "eff", "baseline");
+  if (FLAGS_profile) {
+    printf(" %6s %8s %9s", "IPC", "B/px", "imbalance");
+  }
+  printf("\n");
+
+  std::vector<Result> results;
+  std::map<std::string, double> one_thread_medians;
+  int regressions = 0;
+  for (int threads : thread_counts) {
+    WorkerPool pool(threads);
+    for (const std::pair<int, int>& resolution : resolutions) {
+      for (int num_waves : wave_counts) {
+        for (Kernel kernel : kernels) {
+          Configuration configuration;
+          configuration.kernel = kernel;
+          configuration.width = resolution.first;
+          configuration.height = resolution.second;
+          configuration.num_waves = num_waves;
+          configuration.threads = threads;
+          Result result = Measure(configuration, &pool);
+
+          configuration.threads = 1;
+          const std::string one_thread = ResultName(configuration);
+          if (threads == 1) {
+            one_thread_medians[one_thread] = result.median_ms;
+          }
+          if (one_thread_medians.count(one_thread)) {
+            result.scaling_efficiency =
+                one_thread_medians[one_thread] / (result.median_ms * threads);
+          }
+
+          char efficiency[16] = "-";
+          if (result.scaling_efficiency >= 0.0) {
+            snprintf(efficiency, sizeof(efficiency), "%.2f",
+                     result.scaling_efficiency);
+          }
+          char comparison[32] = "-";
+          if (baseline.count(result.name)) {
+            result.baseline_ratio = result.median_ms / baseline[result.name];
+            const bool regressed =
+                result.baseline_ratio > 1.0 + FLAGS_tolerance;
+            snprintf(comparison, sizeof(comparison), "%+.1f%%%s",
+                     100.0 * (result.baseline_ratio - 1.0),
+                     regressed ? " SLOWER" : "");
+            regressions += regressed;
+          }
+          printf("%-30s %10.2f %7.1f%% %10.3f %9.2f %6s %9s",
+                 result.name.c_str(), result.median_ms,
+                 100.0 * result.stddev_ms / result.mean_ms,
+                 result.ns_per_pixel_wave, result.fps, efficiency,
+                 comparison);
+          if (FLAGS_profile) {
+            if (result.ipc >= 0.0) {
+              printf(" %6.2f %8.2f", result.ipc, result.bytes_per_pixel);
+            } else {
+              printf(" %6s %8s", "n/a", "n/a");
+            }
+            printf(" %9.2f", result.imbalance);
+          }
+          printf("\n");
+          fflush(stdout);
+          results.push_back(result);
+        }
+      }
+    }
+  }
+
+  if (!FLAGS_json.empty() && !WriteJson(FLAGS_json, results)) {
+    printf("Failed to write %s\n", FLAGS_json.c_str());
+    return 1;
+  }
+  if (!baseline.empty()) {
+    if (regressions > 0) {
+      printf("%d configurations regressed by more than %.0f%%.\n",
+             regressions, 100.0 * FLAGS_tolerance);
+      return 1;
+    }
+    printf("No regressions against %s.\n", FLAGS_baseline.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+// Times the wave kernels against each other over a range of wave counts, to
+// find where the NUFFT kernel starts to beat the per pixel kernels.  The
+// result is what kNufftCrossover in wave_kernels.h should be set to.
+//
+// Usage:
+//   ./crossover_benchmark --width=1920 --height=1920 --max_waves=512
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "renderer.h"
+#include "wave_kernels.h"
+#include "wave_table.h"
+
+DEFINE_int32(width, 1024, "Width of the benchmark image.");
+DEFINE_int32(height, 1024, "Height of the benchmark image.");
+DEFINE_double(freq, 1.0 / 5.0, "Frequency of waves.");
+DEFINE_int32(min_waves, 8, "Smallest number of waves to time.");
+DEFINE_int32(max_waves, 512, "Largest number of waves to time.");
+DEFINE_int32(repetitions, 3, "Frames per measurement, the fastest is kept.");
+
+using namespace quasicrystal;
+
+namespace {
+
+// Returns the fastest of FLAGS_repetitions frames, in seconds.
+double TimeKernel(Kernel kernel, const WaveTable& waves, float* out) {
+  RenderParams params;
+  params.kernel = kernel;
+  Renderer renderer(waves, params);
+  double best = 1e100;
+  for (int i = 0; i < FLAGS_repetitions; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    renderer.Render(i, Viewport(0, 0, FLAGS_width, FLAGS_height), out);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  const int num_pixels = FLAGS_width * FLAGS_height;
+  std::vector<float> reference(num_pixels), out(num_pixels);
+  const Kernel kernels[] = {kDirectKernel, kRecurrenceKernel, kNufftKernel};
+
+  printf("%6s %12s %12s %12s %12s %12s\n", "waves", "direct ms",
+         "recur ms", "nufft ms", "recur err", "nufft err");
+  int crossover = -1;
+  for (int n = FLAGS_min_waves; n <= FLAGS_max_waves; n *= 2) {
+    WaveTable waves = MakeCrystalWaves(n, static_cast<float>(FLAGS_freq));
+    double seconds[3];
+    float errors[3] = {0.0f, 0.0f, 0.0f};
+    for (int k = 0; k < 3; ++k) {
+      seconds[k] = TimeKernel(kernels[k], waves, out.data());
+      if (k == 0) {
+        reference.swap(out);
+        continue;
+      }
+      for (int i = 0; i < num_pixels; ++i) {
+        errors[k] = std::max(errors[k], std::abs(out[i] - reference[i]));
+      }
+    }
+    printf("%6d %12.2f %12.2f %12.2f %12.2e %12.2e\n", n,
+           1e3 * seconds[0], 1e3 * seconds[1], 1e3 * seconds[2],
+           errors[1], errors[2]);
+    if (crossover < 0 && seconds[2] < seconds[1]) {
+      crossover = n;
+    }
+  }
+  if (crossover > 0) {
+    printf("NUFFT beats the recurrence from %d waves.\n", crossover);
+  } else {
+    printf("NUFFT never beat the recurrence.\n");
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+// Branch free approximations of transcendental functions, written so that
+// gcc can vectorize loops that call them.  Accurate to a few float ulps
+// for arguments of moderate size.
+
+#ifndef QUASICRYSTAL_FAST_MATH_H
+#define QUASICRYSTAL_FAST_MATH_H
+
+#include <algorithm>
+#include <cmath>
+
+namespace quasicrystal {
+
+// Approximates cos(x).  The argument is reduced to [-pi, pi] in two steps
+// (Cody-Waite), folded to [0, pi / 2], and then fed to the Taylor series
+// to the x^12 term, whose truncation error there is below 1e-8.  Rounding
+// and folding are done arithmetically so the function has no branches.
+inline float FastCos(float x) {
+  const float kInvTwoPi = 0.159154943f;
+  const float kTwoPiHigh = 6.28125f;
+  const float kTwoPiLow = 1.93530717958e-3f;
+  const float kPi = 3.14159265f;
+  const float kHalfPi = 1.57079633f;
+  // Adding and subtracting 1.5 * 2^23 rounds to the nearest integer.
+  const float kRoundMagic = 12582912.0f;
+
+  float q = x * kInvTwoPi;
+  q = (q + kRoundMagic) - kRoundMagic;
+  float r = std::fabs((x - q * kTwoPiHigh) - q * kTwoPiLow);
+  // cos(r) = -cos(pi - r) folds (pi / 2, pi] onto [0, pi / 2).
+  const float sign = 1.0f - 2.0f * static_cast<float>(r > kHalfPi);
+  r = std::min(r, kPi - r);
+
+  const float r2 = r * r;
+  float c = 1.0f / 479001600.0f;
+  c = c * r2 - 1.0f / 3628800.0f;
+  c = c * r2 + 1.0f / 40320.0f;
+  c = c * r2 - 1.0f / 720.0f;
+  c = c * r2 + 1.0f / 24.0f;
+  c = c * r2 - 0.5f;
+  c = c * r2 + 1.0f;
+  return sign * c;
+}
+
+}  // namespace quasicrystal
+
+#endif
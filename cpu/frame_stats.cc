@@ -0,0 +1,94 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace quasicrystal {
+
+namespace {
+
+// Smallest range an exposure may stretch to [0, 1], so that flat frames do
+// not blow up noise.
+const float kMinExposureRange = 1.0f / kHistogramBins;
+
+}  // namespace
+
+FrameStats::FrameStats()
+    : count(0),
+      min(std::numeric_limits<float>::infinity()),
+      max(-std::numeric_limits<float>::infinity()),
+      sum(0.0) {
+  std::fill(histogram, histogram + kHistogramBins, 0);
+}
+
+void FrameStats::Merge(const FrameStats& other) {
+  count += other.count;
+  min = std::min(min, other.min);
+  max = std::max(max, other.max);
+  sum += other.sum;
+  for (int i = 0; i < kHistogramBins; ++i) {
+    histogram[i] += other.histogram[i];
+  }
+}
+
+void FrameStats::Add(const float* values, int n) {
+  // Sum in float over short runs, which vectorizes, and in double across
+  // them, which keeps large frames accurate.
+  const int kRun = 1024;
+  for (int start = 0; start < n; start += kRun) {
+    const int end = std::min(start + kRun, n);
+    float run_min = min, run_max = max, run_sum = 0.0f;
+    for (int i = start; i < end; ++i) {
+      run_min = std::min(run_min, values[i]);
+      run_max = std::max(run_max, values[i]);
+      run_sum += values[i];
+    }
+    min = run_min;
+    max = run_max;
+    sum += run_sum;
+  }
+  for (int i = 0; i < n; ++i) {
+    const float bin = values[i] * kHistogramBins;
+    ++histogram[bin <= 0.0f ? 0 : std::min(static_cast<int>(bin),
+                                           kHistogramBins - 1)];
+  }
+  count += n;
+}
+
+float FrameStats::Percentile(double fraction) const {
+  const double target = fraction * count;
+  long long seen = 0;
+  for (int i = 0; i < kHistogramBins; ++i) {
+    seen += histogram[i];
+    if (seen > 0 && seen >= target) {
+      return static_cast<float>(i + 1) / kHistogramBins;
+    }
+  }
+  return 1.0f;
+}
+
+void Exposure::Apply(float* values, int n) const {
+  const float scale = 1.0f / (white - black);
+  for (int i = 0; i < n; ++i) {
+    values[i] = std::min(std::max((values[i] - black) * scale, 0.0f), 1.0f);
+  }
+}
+
+Exposure AutoExposure(const FrameStats& stats, double clip) {
+  if (stats.count == 0) {
+    return Exposure();
+  }
+  // The bin containing the low percentile starts at its lower edge.
+  float black = stats.Percentile(clip) - 1.0f / kHistogramBins;
+  float white = stats.Percentile(1.0 - clip);
+  black = std::max(black, std::max(stats.min, 0.0f));
+  white = std::min(white, std::min(stats.max, 1.0f));
+  if (white - black < kMinExposureRange) {
+    const float middle = 0.5f * (black + white);
+    black = middle - 0.5f * kMinExposureRange;
+    white = middle + 0.5f * kMinExposureRange;
+  }
+  return Exposure(black, white);
+}
+
+}  // namespace quasicrystal
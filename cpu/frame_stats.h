@@ -0,0 +1,58 @@
+// Statistics of rendered frames, for monitoring unattended renders and for
+// auto-exposure.  Renderers measure each band of a frame as they finish it,
+// while it is still in cache, and merge the bands in order, so the result
+// does not depend on the number of threads.
+
+#ifndef QUASICRYSTAL_FRAME_STATS_H
+#define QUASICRYSTAL_FRAME_STATS_H
+
+namespace quasicrystal {
+
+// Number of histogram bins, evenly spaced over [0, 1].
+const int kHistogramBins = 256;
+
+// Statistics of a set of pixel values, over all channels.
+struct FrameStats {
+  FrameStats();
+
+  // Add the statistics of other, as if its values followed ours.
+  void Merge(const FrameStats& other);
+
+  // Add n values.
+  void Add(const float* values, int n);
+
+  // Mean of the values, or 0 if there are none.
+  double mean() const { return count > 0 ? sum / count : 0.0; }
+
+  // The smallest value that at least fraction of the values are at most, to
+  // the resolution of the histogram.
+  float Percentile(double fraction) const;
+
+  long long count;
+  float min, max;
+  double sum;
+  // Values below 0 count in the first bin, values above 1 in the last.
+  long long histogram[kHistogramBins];
+};
+
+// A linear map of pixel values taking black to 0 and white to 1, clamped.
+struct Exposure {
+  Exposure() : black(0.0f), white(1.0f) {}
+  Exposure(float black, float white) : black(black), white(white) {}
+
+  // Whether this leaves values in [0, 1] alone.
+  bool IsIdentity() const { return black == 0.0f && white == 1.0f; }
+
+  // Apply to n values in place.
+  void Apply(float* values, int n) const;
+
+  float black, white;
+};
+
+// The exposure that stretches the given statistics to the full range,
+// ignoring clip of the values at each end.
+Exposure AutoExposure(const FrameStats& stats, double clip = 0.005);
+
+}  // namespace quasicrystal
+
+#endif
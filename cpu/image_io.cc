@@ -0,0 +1,41 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+namespace quasicrystal {
+
+bool WriteImage(const std::string& filename, const float* pixels,
+                int width, int height, int channels) {
+  if (channels != 1 && channels != 3) {
+    return false;
+  }
+  std::ofstream file(filename, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  return WriteImage(file, pixels, width, height, channels);
+}
+
+bool WriteImage(std::ostream& file, const float* pixels, int width,
+                int height, int channels) {
+  if (channels != 1 && channels != 3) {
+    return false;
+  }
+  file << (channels == 1 ? "P5" : "P6") << "\n"
+       << width << " " << height << "\n255\n";
+  std::vector<uint8_t> row(width * channels);
+  for (int y = height - 1; y >= 0; --y) {
+    const float* src = pixels + y * width * channels;
+    for (int i = 0; i < width * channels; ++i) {
+      const float v = std::min(1.0f, std::max(0.0f, src[i]));
+      row[i] = static_cast<uint8_t>(255.0f * v + 0.5f);
+    }
+    file.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+  return static_cast<bool>(file);
+}
+
+}  // namespace quasicrystal
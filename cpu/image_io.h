@@ -0,0 +1,25 @@
+// Writing rendered frames to disk as binary PGM or PPM files, which need no
+// libraries and which most image tools understand.
+
+#ifndef QUASICRYSTAL_IMAGE_IO_H
+#define QUASICRYSTAL_IMAGE_IO_H
+
+#include <ostream>
+#include <string>
+
+namespace quasicrystal {
+
+// Write a width x height image of float pixels with the given number of
+// channels (1 for PGM, 3 for PPM).  Rows are stored bottom to top, the way
+// OpenGL draws them, and values are clamped to [0, 1].  Returns false if
+// the file could not be written.
+bool WriteImage(const std::string& filename, const float* pixels,
+                int width, int height, int channels);
+
+// As above, to a stream, which may hold a sequence of images.
+bool WriteImage(std::ostream& out, const float* pixels, int width,
+                int height, int channels);
+
+}  // namespace quasicrystal
+
+#endif
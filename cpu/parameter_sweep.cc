@@ -0,0 +1,64 @@
+#include "parameter_sweep.h"
+
+#include <memory>
+
+#include "wave_kernels.h"
+#include "worker_pool.h"
+
+namespace quasicrystal {
+
+namespace {
+
+// Whether the waves have the same trig tables, which only depend on their
+// wave vectors and center.
+bool SameGeometry(const WaveTable& a, const WaveTable& b) {
+  return a.kx == b.kx && a.ky == b.ky && a.center_x == b.center_x &&
+         a.center_y == b.center_y;
+}
+
+}  // namespace
+
+ParameterSweep::ParameterSweep(int width, int height, ColorMode color)
+    : width_(width), height_(height), color_(color) {
+}
+
+void ParameterSweep::AddVariant(const WaveTable& waves, float t) {
+  Variant variant;
+  variant.group = FindGroup(waves);
+  variant.waves = waves;
+  variant.t = t;
+  variants_.push_back(variant);
+}
+
+int ParameterSweep::FindGroup(const WaveTable& waves) {
+  for (int i = 0; i < num_groups(); ++i) {
+    if (SameGeometry(groups_[i], waves)) {
+      return i;
+    }
+  }
+  groups_.push_back(waves);
+  return num_groups() - 1;
+}
+
+void ParameterSweep::Render(WorkerPool* pool,
+                            std::vector<float>* thumbnails) const {
+  // Build the tables for every group, then render every variant from them.
+  std::vector<std::unique_ptr<SeparableTables>> tables(num_groups());
+  pool->Run(num_groups(), [&](int group) {
+    tables[group].reset(
+        new SeparableTables(groups_[group], 0, 0, width_, height_));
+  });
+
+  thumbnails->resize(num_variants() * thumbnail_size());
+  pool->Run(num_variants(), [&](int index) {
+    const Variant& variant = variants_[index];
+    static thread_local std::vector<float> sums;
+    sums.resize(width_ * height_);
+    tables[variant.group]->Sum(variant.waves, variant.t, 0, height_,
+                               sums.data(), width_);
+    ApplyColor(color_, sums.data(), width_ * height_,
+               &(*thumbnails)[index * thumbnail_size()]);
+  });
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,66 @@
+// Renders many variants of a quasicrystal as thumbnails, for searching
+// parameter space.  Variants whose waves have the same wave vectors and
+// center are grouped, and each group's trig tables are built once and shared
+// by every time, phase, angular frequency and amplitude it is rendered with,
+// so a variant only costs two multiply-adds per pixel per wave.
+//
+// Example:
+//   ParameterSweep sweep(128, 128, kGrayColor);
+//   for (float t : times) {
+//     sweep.AddVariant(waves, t);
+//   }
+//   std::vector<float> thumbnails;
+//   sweep.Render(&pool, &thumbnails);
+
+#ifndef QUASICRYSTAL_PARAMETER_SWEEP_H
+#define QUASICRYSTAL_PARAMETER_SWEEP_H
+
+#include <vector>
+
+#include "renderer.h"
+#include "wave_table.h"
+
+namespace quasicrystal {
+
+class WorkerPool;
+
+class ParameterSweep {
+ public:
+  // Thumbnails are width x height pixels, colored with color.
+  ParameterSweep(int width, int height, ColorMode color);
+
+  // Add a thumbnail of waves at time t.  The waves should already be scaled
+  // to thumbnail pixels, see ScaleWaves.
+  void AddVariant(const WaveTable& waves, float t);
+
+  // Render every variant, in the order they were added, into consecutive
+  // thumbnail_size() floats of thumbnails.  Work is spread over the pool.
+  void Render(WorkerPool* pool, std::vector<float>* thumbnails) const;
+
+  int num_variants() const { return static_cast<int>(variants_.size()); }
+  int num_groups() const { return static_cast<int>(groups_.size()); }
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int channels() const { return NumChannels(color_); }
+  int thumbnail_size() const { return width_ * height_ * channels(); }
+
+ private:
+  struct Variant {
+    int group;
+    WaveTable waves;
+    float t;
+  };
+
+  // Index of the group with the geometry of these waves, adding one if
+  // needed.
+  int FindGroup(const WaveTable& waves);
+
+  int width_, height_;
+  ColorMode color_;
+  std::vector<WaveTable> groups_;
+  std::vector<Variant> variants_;
+};
+
+}  // namespace quasicrystal
+
+#endif
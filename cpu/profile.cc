@@ -0,0 +1,197 @@
+#include "profile.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace quasicrystal {
+
+namespace {
+
+// Bytes per cache line.
+const int kCacheLineBytes = 64;
+
+// Events in a counter group, in the order they are read.
+const uint64_t kEvents[] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_REFERENCES,
+  PERF_COUNT_HW_CACHE_MISSES,
+};
+const int kNumEvents = sizeof(kEvents) / sizeof(kEvents[0]);
+
+// Open a counter of event for the calling thread in group, or as a new
+// group leader if group is -1.  Returns -1 on failure.
+int OpenCounter(uint64_t event, int group) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = event;
+  attr.read_format = PERF_FORMAT_GROUP;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(
+      syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+}
+
+double Milliseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+void PerfCounts::Add(const PerfCounts& other) {
+  cycles += other.cycles;
+  instructions += other.instructions;
+  cache_references += other.cache_references;
+  cache_misses += other.cache_misses;
+}
+
+PerfCounters::PerfCounters() : group_(OpenCounter(kEvents[0], -1)) {
+  for (int i = 1; i < kNumEvents && group_ >= 0; ++i) {
+    const int fd = OpenCounter(kEvents[i], group_);
+    if (fd < 0) {
+      // A partial group would make every count suspect.
+      for (int member : members_) {
+        close(member);
+      }
+      members_.clear();
+      close(group_);
+      group_ = -1;
+    } else {
+      members_.push_back(fd);
+    }
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (int member : members_) {
+    close(member);
+  }
+  if (group_ >= 0) {
+    close(group_);
+  }
+}
+
+PerfCounts PerfCounters::Read() const {
+  PerfCounts counts;
+  // With PERF_FORMAT_GROUP, the number of events followed by their values.
+  uint64_t values[1 + kNumEvents];
+  if (group_ < 0 ||
+      read(group_, values, sizeof(values)) != sizeof(values)) {
+    return counts;
+  }
+  counts.cycles = values[1];
+  counts.instructions = values[2];
+  counts.cache_references = values[3];
+  counts.cache_misses = values[4];
+  return counts;
+}
+
+FrameProfile::FrameProfile()
+    : num_threads_(0),
+      num_passes_(0),
+      pixels_(0),
+      wall_ms_(0.0),
+      counters_available_(false) {}
+
+void FrameProfile::Begin(int num_threads, long long pixels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  start_ = Clock::now();
+  thread_index_.clear();
+  num_threads_ = num_threads;
+  num_passes_ = 0;
+  pixels_ = pixels;
+  wall_ms_ = 0.0;
+  counters_available_ = true;
+  tasks_.clear();
+}
+
+int FrameProfile::BeginPass() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_passes_++;
+}
+
+void FrameProfile::RunTask(int pass, int index,
+                           const std::function<void(int)>& task) {
+  // Counters stay open for the life of each thread that has ever run a
+  // profiled task, so only the first task pays for opening them.
+  static thread_local PerfCounters counters;
+  const PerfCounts before = counters.Read();
+  const Clock::time_point start = Clock::now();
+  task(index);
+  const Clock::time_point end = Clock::now();
+  const PerfCounts after = counters.Read();
+
+  TaskProfile profile;
+  profile.pass = pass;
+  profile.task = index;
+  profile.start_ms = Milliseconds(start - start_);
+  profile.busy_ms = Milliseconds(end - start);
+  profile.counts.cycles = after.cycles - before.cycles;
+  profile.counts.instructions = after.instructions - before.instructions;
+  profile.counts.cache_references =
+      after.cache_references - before.cache_references;
+  profile.counts.cache_misses = after.cache_misses - before.cache_misses;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto thread = thread_index_.insert(std::make_pair(
+      std::this_thread::get_id(), static_cast<int>(thread_index_.size())));
+  profile.thread = thread.first->second;
+  counters_available_ &= counters.available();
+  tasks_.push_back(profile);
+}
+
+void FrameProfile::End() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  wall_ms_ = Milliseconds(Clock::now() - start_);
+  num_threads_ = std::max(num_threads_,
+                          static_cast<int>(thread_index_.size()));
+  counters_available_ &= !tasks_.empty();
+}
+
+PerfCounts FrameProfile::counts() const {
+  PerfCounts counts;
+  for (const TaskProfile& task : tasks_) {
+    counts.Add(task.counts);
+  }
+  return counts;
+}
+
+std::vector<ThreadProfile> FrameProfile::threads() const {
+  std::vector<ThreadProfile> threads(num_threads_);
+  for (const TaskProfile& task : tasks_) {
+    ThreadProfile& thread = threads[task.thread];
+    thread.busy_ms += task.busy_ms;
+    ++thread.tasks;
+    thread.counts.Add(task.counts);
+  }
+  return threads;
+}
+
+double FrameProfile::ipc() const {
+  const PerfCounts total = counts();
+  return total.cycles > 0 ?
+      static_cast<double>(total.instructions) / total.cycles : 0.0;
+}
+
+double FrameProfile::bytes_per_pixel() const {
+  return pixels_ > 0 ?
+      static_cast<double>(counts().cache_misses) * kCacheLineBytes / pixels_ :
+      0.0;
+}
+
+double FrameProfile::imbalance() const {
+  double max_busy = 0.0, total_busy = 0.0;
+  for (const ThreadProfile& thread : threads()) {
+    max_busy = std::max(max_busy, thread.busy_ms);
+    total_busy += thread.busy_ms;
+  }
+  return total_busy > 0.0 ? max_busy * num_threads_ / total_busy : 1.0;
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,134 @@
+// Optional profiling of rendered frames, to tell whether a slow frame is
+// bound by computing the waves, by memory traffic, or by threads waiting on
+// each other.  Renderers time every task they run, such as a band of rows,
+// and read the hardware counters of the thread that ran it through
+// perf_event_open.  Nothing is measured unless a FrameProfile is passed in.
+//
+// Hardware counters may be unavailable, for example in containers or with a
+// high kernel.perf_event_paranoid, in which case only times are recorded.
+
+#ifndef QUASICRYSTAL_PROFILE_H
+#define QUASICRYSTAL_PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace quasicrystal {
+
+// Hardware event counts over a span of one thread, in user space.
+struct PerfCounts {
+  PerfCounts()
+      : cycles(0), instructions(0), cache_references(0), cache_misses(0) {}
+
+  void Add(const PerfCounts& other);
+
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t cache_references;
+  // Misses in the last level cache, which mostly go to memory.
+  uint64_t cache_misses;
+};
+
+// Counters of the thread that creates them, until they are destroyed.
+class PerfCounters {
+ public:
+  PerfCounters();
+  ~PerfCounters();
+
+  // Whether the kernel let us open the counters.  If not, Read gives zeros.
+  bool available() const { return group_ >= 0; }
+
+  // The counts since the counters were opened.
+  PerfCounts Read() const;
+
+ private:
+  // File descriptor of the group leader, which counts cycles, or -1.
+  int group_;
+  // The other counters in the group.
+  std::vector<int> members_;
+};
+
+// One task of a frame, as run on one thread.
+struct TaskProfile {
+  // Which parallel pass of the frame the task belongs to, and its index in
+  // the pass.
+  int pass;
+  int task;
+  // Index of the thread that ran it, in order of first appearance.
+  int thread;
+  // Start and duration, in milliseconds from the start of the frame.
+  double start_ms;
+  double busy_ms;
+  PerfCounts counts;
+};
+
+// Busy and idle time of one thread over a frame.
+struct ThreadProfile {
+  ThreadProfile() : busy_ms(0.0), tasks(0) {}
+  double busy_ms;
+  int tasks;
+  PerfCounts counts;
+};
+
+// Everything measured about one frame.  Renderers call Begin, RunTask for
+// each task and End; the rest is for reading the results.  RunTask is
+// thread-safe.
+class FrameProfile {
+ public:
+  FrameProfile();
+
+  // Start a frame of pixels on num_threads threads.
+  void Begin(int num_threads, long long pixels);
+
+  // Start a new parallel pass, and return its number.
+  int BeginPass();
+
+  // Run task(index) on the calling thread, recording it as part of pass.
+  void RunTask(int pass, int index, const std::function<void(int)>& task);
+
+  void End();
+
+  // Whether hardware counts were recorded.
+  bool counters_available() const { return counters_available_; }
+
+  double wall_ms() const { return wall_ms_; }
+  long long pixels() const { return pixels_; }
+  int num_threads() const { return num_threads_; }
+  const std::vector<TaskProfile>& tasks() const { return tasks_; }
+
+  // Totals over all tasks and per thread.  Threads that ran no tasks are
+  // included, all idle.
+  PerfCounts counts() const;
+  std::vector<ThreadProfile> threads() const;
+
+  // Instructions per cycle.
+  double ipc() const;
+  // Bytes moved to and from memory per pixel, estimated as one cache line
+  // per last level cache miss.
+  double bytes_per_pixel() const;
+  // The busiest thread's busy time over the mean busy time of all threads,
+  // 1 when the work is perfectly balanced.
+  double imbalance() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  std::mutex mutex_;
+  Clock::time_point start_;
+  std::map<std::thread::id, int> thread_index_;
+  int num_threads_;
+  int num_passes_;
+  long long pixels_;
+  double wall_ms_;
+  bool counters_available_;
+  std::vector<TaskProfile> tasks_;
+};
+
+}  // namespace quasicrystal
+
+#endif
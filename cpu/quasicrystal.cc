@@ -3,15 +3,32 @@
 // which is in turn based on code from Keegan McAllister:
 // http://mainisusuallyafunction.blogspot.com/2011/10/quasicrystals-as-sums-of-waves-in-plane.html
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 #include <gflags/gflags.h>
 #include <GL/gl.h>
 #include <GL/glx.h>
+#include <X11/keysym.h>
 
+#include "common/qc_params.h"
+#include "common/session.h"
+#include "common/trace.h"
+#include "auto_tuner.h"
+#include "image_io.h"
+#include "profile.h"
+#include "renderer.h"
+#include "shader_model.h"
+#include "wave_kernels.h"
+#include "wave_table.h"
 #include "window.h"
+#include "worker_pool.h"
 
 DEFINE_int32(width, 400, "Width of output image.");
 DEFINE_int32(height, 400, "Height of output image.");
@@ -21,80 +38,588 @@ DEFINE_bool(view_mode, true,
             "Set to true to run visualization, set to false to "
             "run benchmark");
 DEFINE_int32(benchmark_steps, 10, "Number of steps to take in benchmark");
+DEFINE_bool(antialias, false,
+            "Prefilter each wave over the pixel footprint before the "
+            "nonlinearity, instead of point sampling it.");
+DEFINE_string(kernel, "simd",
+              "Kernel used to sum the waves: direct, simd, recurrence, nufft, "
+              "separable, or auto to pick based on the number of waves.");
+DEFINE_string(symmetry, "none",
+              "Symmetry to exploit in frames that have it, as the first "
+              "frame does: none, mirror to copy pixels across the mirrors "
+              "and quarter turns of the pixel grid, or full to also "
+              "resample the rest of the dihedral symmetry of the waves, "
+              "which pays off with many waves.  The symmetry is about the "
+              "field origin, so this needs it near the middle of the frame, "
+              "as in the shader model; the cpu model's origin is its "
+              "bottom left corner.");
+DEFINE_string(model, "cpu",
+              "Quasicrystal model to render: cpu, equal frequency waves with "
+              "fixed phase velocities, or shader, the model of the shader "
+              "viewer configured by --wavenumbers, --angular_frequencies "
+              "and --mix.");
+DEFINE_string(wavenumbers,
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2",
+              "Comma seperated list of per wave wavenumbers, shader model "
+              "only.");
+DEFINE_string(angular_frequencies,
+              "1.0, 0.9, 0.8, 0.7, 0.6,"
+              "0.5, 0.4, 0.3, 0.2, 0.1,"
+              "0.1, 0.2, 0.3, 0.4, 0.5",
+              "Comma seperated list of wave angular frequencies, shader "
+              "model only.");
+DEFINE_double(mix, 0.0,
+              "Mixing parameter between num_waves and num_waves + 1 waves, "
+              "shader model only.");
+DEFINE_double(dt, 0.05, "Time per step, shader model only.");
+DEFINE_double(shutter_angle, 0.0,
+              "If positive, blur the motion over this fraction of each step, "
+              "in degrees out of 360, by averaging each wave over it.");
+DEFINE_bool(auto_exposure, false,
+            "Stretch each frame to the range of values in the frame before "
+            "it.");
+DEFINE_bool(profile, false,
+            "Print the time, instructions per cycle, memory traffic per "
+            "pixel and per thread busy and idle time of each frame, from "
+            "hardware counters where the kernel allows.");
+DEFINE_bool(frame_stats, false,
+            "Print the min, max and mean of each frame in the benchmark, "
+            "before any exposure.");
+DEFINE_int32(threads, 0,
+             "Worker threads to render on, or 0 to let OpenMP decide.");
+DEFINE_int32(band_height, 0,
+             "Rows in each independently rendered band, or 0 for the "
+             "kernel's default.");
+DEFINE_bool(auto_tune, false,
+            "Use the fastest kernel, band height and thread count for this "
+            "machine and frame, overriding --kernel, --band_height and "
+            "--threads.  The first run times short trials of each and "
+            "stores the result in --tune_cache for later runs.");
+DEFINE_bool(retune, false,
+            "With --auto_tune, time the trials again even if the cache has "
+            "a result.");
+DEFINE_string(tune_cache, "",
+              "File of auto-tuned configurations, by default "
+              "~/.quasicrystal_tune.");
+DEFINE_string(trace, "",
+              "If set, record when each part of every frame runs, on every "
+              "thread, and write it to this file on exit as Chrome trace "
+              "event JSON.");
+DEFINE_string(output, "",
+              "If set, the benchmark writes its last frame to this file, "
+              "as PGM for the cpu model or PPM for the shader model.");
+DEFINE_string(replay, "",
+              "If set, benchmark the frames of this session recorded by the "
+              "shader viewer with the shader model, at the recorded size "
+              "and with the recorded view and shutter, instead of opening a "
+              "window.");
 
-static void ComputeWave(float* img, int step) {
-  const float freq = static_cast<float>(FLAGS_freq);
-
-  // Initializes phases and angles.
-  std::vector<float> coses(FLAGS_num_waves);
-  std::vector<float> sines(FLAGS_num_waves);
-  for (int i = 0; i < FLAGS_num_waves; ++i) {
-    float angle = i * M_PI / FLAGS_num_waves;
-    coses[i] = cos(angle);
-    sines[i] = sin(angle);
-  }
-
-  #pragma omp parallel for
-  for (int y = 0; y < FLAGS_height; ++y) {
-    for (int x = 0; x < FLAGS_width; ++x) {
-      const int idx = FLAGS_width * y + x;
-      float p = 0;
-      for (int w = 0; w < FLAGS_num_waves; w += 1) {
-        const float cx = coses[w] * x;
-        const float sy = sines[w] * y;
-        const float phase = step * 0.05 * (w + 1);
-        p += 0.5 * (cos(freq * (cx + sy) + phase) + 1);
+using quasicrystal::Exposure;
+using quasicrystal::FrameProfile;
+using quasicrystal::FrameStats;
+using quasicrystal::QCParams;
+using quasicrystal::TuneCache;
+using quasicrystal::TunedConfiguration;
+using quasicrystal::RenderParams;
+using quasicrystal::Renderer;
+using quasicrystal::Viewport;
+using quasicrystal::WaveTable;
+using quasicrystal::WorkerPool;
+
+static bool IsShaderModel() {
+  return FLAGS_model == "shader";
+}
+
+// The render settings described by the command line flags.
+static RenderParams RenderParamsFromFlags() {
+  RenderParams render_params;
+  render_params.kernel = quasicrystal::ChooseKernel(FLAGS_num_waves);
+  if (FLAGS_kernel != "auto" &&
+      !quasicrystal::ParseKernel(FLAGS_kernel, &render_params.kernel)) {
+    std::cerr << "Unknown kernel " << FLAGS_kernel << std::endl;
+    exit(1);
+  }
+  render_params.antialias = FLAGS_antialias;
+  if (!quasicrystal::ParseSymmetryMode(FLAGS_symmetry,
+                                       &render_params.symmetry)) {
+    std::cerr << "Unknown symmetry " << FLAGS_symmetry << std::endl;
+    exit(1);
+  }
+  render_params.band_height = FLAGS_band_height;
+  // Time passes at --dt per step in the shader model, 1 in the cpu model.
+  render_params.shutter = static_cast<float>(
+      FLAGS_shutter_angle / 360.0 * (IsShaderModel() ? FLAGS_dt : 1.0));
+  if (IsShaderModel()) {
+    render_params.color = quasicrystal::kRotorColor;
+  }
+  return render_params;
+}
+
+// The waves described by the command line flags.
+static WaveTable WavesFromFlags() {
+  if (IsShaderModel()) {
+    QCParams params = quasicrystal::ParseQCParams(
+        FLAGS_num_waves, FLAGS_angular_frequencies, FLAGS_wavenumbers);
+    params.mix = FLAGS_mix;
+    return quasicrystal::MakeShaderWaves(params, FLAGS_width, FLAGS_height);
+  }
+  return quasicrystal::MakeCrystalWaves(FLAGS_num_waves,
+                                        static_cast<float>(FLAGS_freq));
+}
+
+// Replace the kernel, band height and thread count with the tuned ones for
+// this machine, tuning and caching them first if need be.
+static void AutoTune(const WaveTable& waves, RenderParams* render_params,
+                     int* threads) {
+  const std::string path = FLAGS_tune_cache.empty() ?
+                           TuneCache::DefaultPath() : FLAGS_tune_cache;
+  TuneCache cache(path);
+  const std::string key =
+      TuneCache::Key(waves, *render_params, FLAGS_width, FLAGS_height);
+  TunedConfiguration tuned;
+  if (FLAGS_retune || !cache.Lookup(key, &tuned)) {
+    std::cout << "Tuning for " << key << std::endl;
+    std::vector<TunedConfiguration> trials;
+    tuned = quasicrystal::AutoTune(waves, *render_params, FLAGS_width,
+                                   FLAGS_height, quasicrystal::TuneOptions(),
+                                   &trials);
+    for (const TunedConfiguration& trial : trials) {
+      std::cout << "  " << quasicrystal::KernelName(trial.kernel)
+                << " bands " << trial.band_height << " threads "
+                << trial.threads << ": ";
+      if (std::isinf(trial.frame_ms)) {
+        std::cout << "skipped, too slow" << std::endl;
+      } else {
+        std::cout << trial.frame_ms << " ms" << std::endl;
       }
-      p = 0.5 * (cos(M_PI * p) + 1);
-      //      const uint8_t tmp = static_cast<uint8_t>(
-      //          255 * std::min(1.0f, std::max(p, 0.0f)));
-      img[idx] = p;
     }
+    if (!cache.Store(key, tuned)) {
+      std::cerr << "Failed to write " << path << std::endl;
+    }
+  }
+  std::cout << "Tuned: " << quasicrystal::KernelName(tuned.kernel)
+            << ", bands " << tuned.band_height << ", " << tuned.threads
+            << " threads, " << tuned.frame_ms << " ms per frame" << std::endl;
+  render_params->kernel = tuned.kernel;
+  render_params->band_height = tuned.band_height;
+  *threads = tuned.threads;
+}
+
+// The time of the given step.
+static float StepTime(int step) {
+  return IsShaderModel() ? step * FLAGS_dt : step;
+}
+
+// Print the profile of a step.
+static void PrintProfile(int step, const FrameProfile& profile) {
+  std::cout << "step " << step << ": " << profile.wall_ms() << " ms";
+  if (profile.counters_available()) {
+    std::cout << ", IPC " << profile.ipc() << ", "
+              << profile.bytes_per_pixel() << " B/px";
+  }
+  std::cout << ", imbalance " << profile.imbalance() << ", busy/idle ms";
+  const std::vector<quasicrystal::ThreadProfile> threads = profile.threads();
+  for (const quasicrystal::ThreadProfile& thread : threads) {
+    std::cout << " " << thread.busy_ms << "/"
+              << profile.wall_ms() - thread.busy_ms;
+  }
+  std::cout << std::endl;
+}
+
+// Render a step over the viewport on the pool, or with OpenMP if it is
+// null, with the given exposure, and update the exposure for the next step
+// if --auto_exposure is set.  If stats is not null it receives the
+// statistics of the step.  With --profile, the step's profile is printed.
+static void ComputeWave(const Renderer& renderer, WorkerPool* pool,
+                        const Viewport& viewport, float* img, int step,
+                        Exposure* exposure, FrameStats* stats) {
+  TRACE_SPAN("ComputeWave");
+  FrameStats frame_stats;
+  FrameProfile profile;
+  const bool measure = FLAGS_auto_exposure || stats != nullptr;
+  renderer.Render(StepTime(step), viewport, img, pool, *exposure,
+                  measure ? &frame_stats : nullptr,
+                  FLAGS_profile ? &profile : nullptr);
+  if (FLAGS_auto_exposure) {
+    *exposure = quasicrystal::AutoExposure(frame_stats);
+  }
+  if (stats != nullptr) {
+    *stats = frame_stats;
   }
+  if (FLAGS_profile) {
+    PrintProfile(step, profile);
+  }
+}
 
+// Write the trace to --trace, if it is set.
+static void WriteTrace() {
+  if (!FLAGS_trace.empty() && !quasicrystal::trace::WriteJson(FLAGS_trace)) {
+    std::cerr << "Failed to write " << FLAGS_trace << std::endl;
+  }
 }
 
+// Render every frame of the session in --replay with the shader model, and
+// report the time taken.  The waves are only rebuilt when a frame changes
+// more than the time.  Returns false if the session can not be read.
+static bool ReplaySession(WorkerPool* pool) {
+  int width, height;
+  std::vector<quasicrystal::SessionFrame> frames;
+  if (!quasicrystal::ReadSession(FLAGS_replay, &width, &height, &frames) ||
+      frames.empty()) {
+    std::cerr << "Failed to read session " << FLAGS_replay << std::endl;
+    return false;
+  }
+  RenderParams render_params = RenderParamsFromFlags();
+  render_params.color = quasicrystal::kRotorColor;
+  std::vector<float> pixels(width * height * 3);
+  std::unique_ptr<Renderer> renderer;
+  quasicrystal::SessionFrame current;
+  int rebuilds = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const quasicrystal::SessionFrame& frame = frames[i];
+    current.params.t = frame.params.t;
+    if (renderer == nullptr || !quasicrystal::SameFrame(frame, current)) {
+      TRACE_SPAN("MakeShaderWaves");
+      WaveTable waves =
+          quasicrystal::MakeShaderWaves(frame.params, width, height);
+      quasicrystal::ApplyShaderView(frame.view_x, frame.view_y,
+                                    frame.view_scale, &waves);
+      if (FLAGS_kernel == "auto") {
+        render_params.kernel = quasicrystal::ChooseKernel(waves.size());
+      }
+      render_params.antialias = frame.antialias;
+      render_params.shutter = frame.shutter;
+      renderer.reset(new Renderer(waves, render_params));
+      current = frame;
+      ++rebuilds;
+    }
+    TRACE_SPAN("ComputeWave");
+    renderer->Render(frame.params.t, Viewport(0, 0, width, height),
+                     pixels.data(), pool);
+  }
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  std::cout << "Replayed " << frames.size() << " frames of " << width << "x"
+            << height << " in " << seconds << " s, "
+            << 1e3 * seconds / frames.size() << " ms per frame, "
+            << rebuilds << " wave tables built" << std::endl;
+  if (!FLAGS_output.empty() &&
+      !quasicrystal::WriteImage(FLAGS_output, pixels.data(), width, height,
+                                3)) {
+    std::cout << "Failed to write " << FLAGS_output << std::endl;
+  }
+  return true;
+}
+
+// The viewer's controls are
+//   space       pause
+//   arrow keys  pan
+//   page up and page down   zoom in or out
+//   home        go back to the initial view
+// While paused, panning moves the frame and only renders the strips it
+// uncovers, and zooming shows the frame resampled until the exact frame,
+// rendered in the background, replaces it.
 class WaveWindow : public util::Window {
  public:
-  WaveWindow()
+  WaveWindow(const WaveTable& waves, const RenderParams& render_params,
+             WorkerPool* pool)
       : util::Window("quasicrystal", FLAGS_width, FLAGS_height),
-        pixels_(new float [FLAGS_width * FLAGS_height]),
-        step_(0) {
-  }
-  virtual ~WaveWindow() {
-    delete[] pixels_;
+        waves_(waves),
+        render_params_(render_params),
+        renderer_(std::make_shared<Renderer>(waves, render_params)),
+        pool_(pool),
+        pixels_(FLAGS_width * FLAGS_height * renderer_->channels()),
+        step_(0),
+        paused_(false),
+        drawn_(false),
+        exact_(false),
+        pan_x_(0),
+        pan_y_(0),
+        scale_(1.0f) {
   }
 
  protected:
   virtual void HandleClose() {
+    WriteTrace();
     exit(0);
   }
 
-  virtual void HandleKey(unsigned int state, unsigned int keycode) {
+  virtual void HandleKey(unsigned int state, unsigned int key) {
+    switch (key) {
+      case XK_space:
+        paused_ = !paused_;
+        break;
+      case XK_Left:
+        Pan(-std::max(1, FLAGS_width / 8), 0);
+        break;
+      case XK_Right:
+        Pan(std::max(1, FLAGS_width / 8), 0);
+        break;
+      case XK_Down:
+        Pan(0, -std::max(1, FLAGS_height / 8));
+        break;
+      case XK_Up:
+        Pan(0, std::max(1, FLAGS_height / 8));
+        break;
+      case XK_Page_Up:
+        Zoom(1.25f);
+        break;
+      case XK_Page_Down:
+        Zoom(0.8f);
+        break;
+      case XK_Home:
+        if (scale_ == 1.0f) {
+          Pan(-pan_x_, -pan_y_);
+        } else {
+          SetView(0, 0, 1.0f);
+        }
+        break;
+    }
   }
 
   virtual void HandleDraw() {
-    ++step_;
-    ComputeWave(pixels_, step_);
-    
+    CollectBackgroundFrame();
+    if (!paused_ || !drawn_) {
+      if (!paused_) {
+        ++step_;
+      }
+      frame_exposure_ = exposure_;
+      ComputeWave(*renderer_, pool_, ViewViewport(), pixels_.data(), step_,
+                  &exposure_, nullptr);
+      drawn_ = true;
+      exact_ = true;
+    }
+
     // Clear the screen.
     glClear(GL_COLOR_BUFFER_BIT);
 
+    TRACE_SPAN("glDrawPixels");
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glRasterPos2i(0, 0);
     glDrawPixels(FLAGS_width,
                  FLAGS_height,
-                 GL_LUMINANCE, GL_FLOAT,
-                 pixels_);
+                 renderer_->channels() == 3 ? GL_RGB : GL_LUMINANCE,
+                 GL_FLOAT,
+                 pixels_.data());
   }
 
  private:
-  float* pixels_;
+  // What a frame shows.
+  struct View {
+    int pan_x, pan_y;
+    float scale;
+    int step;
+  };
+
+  // The window's frame, in the pixels of the current scale.
+  Viewport ViewViewport() const {
+    return Viewport(pan_x_, pan_y_, FLAGS_width, FLAGS_height);
+  }
+
+  // Move the view by dx, dy pixels.  When paused, the frame moves with it
+  // and only the strips it uncovers are rendered.
+  void Pan(int dx, int dy) {
+    pan_x_ += dx;
+    pan_y_ += dy;
+    if (!paused_ || !drawn_) {
+      return;
+    }
+    const int width = FLAGS_width;
+    const int height = FLAGS_height;
+    if (std::abs(dx) >= width || std::abs(dy) >= height) {
+      drawn_ = false;
+      return;
+    }
+    TRACE_SPAN("PanFrame");
+    const int channels = renderer_->channels();
+    std::vector<float> shifted(pixels_.size());
+    // Pixel (x, y) of the new frame is pixel (x + dx, y + dy) of the old.
+    const int x_begin = std::max(0, -dx);
+    const int x_end = std::min(width, width - dx);
+    for (int y = std::max(0, -dy); y < std::min(height, height - dy); ++y) {
+      std::copy(pixels_.begin() + ((y + dy) * width + x_begin + dx) * channels,
+                pixels_.begin() + ((y + dy) * width + x_end + dx) * channels,
+                shifted.begin() + (y * width + x_begin) * channels);
+    }
+    pixels_.swap(shifted);
+    if (dx != 0) {
+      RenderStrip(dx > 0 ? width - dx : 0, 0, std::abs(dx), height);
+    }
+    if (dy != 0) {
+      RenderStrip(0, dy > 0 ? height - dy : 0, width, std::abs(dy));
+    }
+  }
+
+  // Render the given rectangle of the window's frame into pixels_.
+  void RenderStrip(int x, int y, int width, int height) {
+    const int channels = renderer_->channels();
+    std::vector<float> strip(width * height * channels);
+    renderer_->Render(StepTime(step_),
+                      Viewport(pan_x_ + x, pan_y_ + y, width, height),
+                      strip.data(), pool_, frame_exposure_, nullptr);
+    for (int row = 0; row < height; ++row) {
+      std::copy(strip.begin() + row * width * channels,
+                strip.begin() + (row + 1) * width * channels,
+                pixels_.begin() + ((y + row) * FLAGS_width + x) * channels);
+    }
+  }
+
+  // Zoom in by factor about the center of the window.
+  void Zoom(float factor) {
+    const float scale = scale_ / factor;
+    // Pixel x at scale s is at pixel s * (x + 0.5) - 0.5 of the initial
+    // view, so this keeps the center where it is, to the nearest pixel.
+    SetView(static_cast<int>(std::lround(
+                factor * (pan_x_ + 0.5f * FLAGS_width) - 0.5f * FLAGS_width)),
+            static_cast<int>(std::lround(
+                factor * (pan_y_ + 0.5f * FLAGS_height) -
+                0.5f * FLAGS_height)),
+            scale);
+  }
+
+  // Show the view at scale, in units of the initial view's pixels per
+  // pixel, panned by pan_x, pan_y pixels.  When paused, the frame is
+  // resampled to the new view until the exact frame is rendered in the
+  // background.
+  void SetView(int pan_x, int pan_y, float scale) {
+    if (paused_ && drawn_) {
+      TRACE_SPAN("ResampleFrame");
+      const int width = FLAGS_width;
+      const int height = FLAGS_height;
+      const int channels = renderer_->channels();
+      const float ratio = scale / scale_;
+      std::vector<int> columns(width);
+      for (int x = 0; x < width; ++x) {
+        columns[x] = std::min(width - 1, std::max(0, static_cast<int>(
+            std::lround(ratio * (pan_x + x + 0.5f) - 0.5f - pan_x_))));
+      }
+      std::vector<float> resampled(pixels_.size());
+      for (int y = 0; y < height; ++y) {
+        const int row = std::min(height - 1, std::max(0, static_cast<int>(
+            std::lround(ratio * (pan_y + y + 0.5f) - 0.5f - pan_y_))));
+        for (int x = 0; x < width; ++x) {
+          std::copy(pixels_.begin() + (row * width + columns[x]) * channels,
+                    pixels_.begin() + (row * width + columns[x] + 1) *
+                                          channels,
+                    resampled.begin() + (y * width + x) * channels);
+        }
+      }
+      pixels_.swap(resampled);
+      exact_ = false;
+    }
+    pan_x_ = pan_x;
+    pan_y_ = pan_y;
+    if (scale != scale_) {
+      scale_ = scale;
+      WaveTable waves = waves_;
+      quasicrystal::ScaleWaves(scale, &waves);
+      renderer_ = std::make_shared<Renderer>(waves, render_params_);
+    }
+    if (!exact_) {
+      StartBackgroundFrame();
+    }
+  }
+
+  // Start rendering the current view in the background, unless a frame is
+  // already being rendered, in which case this one starts when it is done.
+  void StartBackgroundFrame() {
+    if (background_.valid()) {
+      return;
+    }
+    background_view_ = {pan_x_, pan_y_, scale_, step_};
+    const std::shared_ptr<const Renderer> renderer = renderer_;
+    const Viewport viewport = ViewViewport();
+    const float t = StepTime(step_);
+    const Exposure exposure = frame_exposure_;
+    WorkerPool* pool = pool_;
+    background_ = std::async(std::launch::async, [=]() {
+      TRACE_SPAN("BackgroundFrame");
+      std::vector<float> pixels(viewport.width * viewport.height *
+                                renderer->channels());
+      renderer->Render(t, viewport, pixels.data(), pool, exposure, nullptr);
+      return pixels;
+    });
+  }
+
+  // If the background frame is done, show it if it is still of the current
+  // view, and otherwise start on the current view.
+  void CollectBackgroundFrame() {
+    if (!background_.valid() ||
+        background_.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+      return;
+    }
+    std::vector<float> pixels = background_.get();
+    if (exact_) {
+      return;
+    }
+    if (background_view_.pan_x == pan_x_ &&
+        background_view_.pan_y == pan_y_ &&
+        background_view_.scale == scale_ && background_view_.step == step_) {
+      pixels_.swap(pixels);
+      exact_ = true;
+    } else if (paused_) {
+      StartBackgroundFrame();
+    }
+  }
+
+  // Waves and settings of the initial view.
+  const WaveTable waves_;
+  const RenderParams render_params_;
+  // Renders the current scale.
+  std::shared_ptr<const Renderer> renderer_;
+  WorkerPool* pool_;
+  std::vector<float> pixels_;
   int step_;
+  bool paused_;
+  // Whether pixels_ holds a frame, and whether it is exactly the current
+  // view rather than a resampled preview.
+  bool drawn_;
+  bool exact_;
+  // Pan, in pixels of the current scale, and the scale, in pixels of the
+  // initial view per pixel.
+  int pan_x_, pan_y_;
+  float scale_;
+  // The exposure of the next step, which --auto_exposure sets from each
+  // step, and the one pixels_ was rendered with, for rendering more of it.
+  Exposure exposure_;
+  Exposure frame_exposure_;
+  std::future<std::vector<float>> background_;
+  View background_view_;
 };
 
 int main(int argc, char** argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_model != "cpu" && !IsShaderModel()) {
+    std::cout << "Unknown model " << FLAGS_model << std::endl;
+    return 1;
+  }
+  if (!FLAGS_trace.empty()) {
+    quasicrystal::trace::Start();
+    quasicrystal::trace::SetThreadName("main");
+  }
+  if (!FLAGS_replay.empty()) {
+    std::unique_ptr<WorkerPool> pool;
+    if (FLAGS_threads > 0) {
+      pool.reset(new WorkerPool(FLAGS_threads));
+    }
+    const bool replayed = ReplaySession(pool.get());
+    WriteTrace();
+    return replayed ? 0 : 1;
+  }
+  const WaveTable waves = WavesFromFlags();
+  RenderParams render_params = RenderParamsFromFlags();
+  int threads = FLAGS_threads;
+  if (FLAGS_auto_tune) {
+    AutoTune(waves, &render_params, &threads);
+  }
+  std::unique_ptr<WorkerPool> pool;
+  if (threads > 0) {
+    pool.reset(new WorkerPool(threads));
+  }
 
   if (FLAGS_view_mode) {
     if (XInitThreads() == 0) {
@@ -103,13 +628,30 @@ int main(int argc, char** argv) {
     }
     // Creating a window object already makes a thread and starts running.
     // That interface should probably be made better :/
-    WaveWindow window;
+    WaveWindow window(waves, render_params, pool.get());
     getchar();
+    WriteTrace();
   } else {
-    float* pixels = new float [FLAGS_width * FLAGS_height];
+    const Renderer renderer(waves, render_params);
+    float* pixels =
+        new float [FLAGS_width * FLAGS_height * renderer.channels()];
+    Exposure exposure;
     for (int i = 0; i < FLAGS_benchmark_steps; ++i) {
-      ComputeWave(pixels, i);
+      FrameStats stats;
+      ComputeWave(renderer, pool.get(),
+                  Viewport(0, 0, FLAGS_width, FLAGS_height), pixels, i,
+                  &exposure, FLAGS_frame_stats ? &stats : nullptr);
+      if (FLAGS_frame_stats) {
+        std::cout << "step " << i << ": min " << stats.min << " max "
+                  << stats.max << " mean " << stats.mean() << std::endl;
+      }
+    }
+    if (!FLAGS_output.empty() &&
+        !quasicrystal::WriteImage(FLAGS_output, pixels, FLAGS_width,
+                                  FLAGS_height, renderer.channels())) {
+      std::cout << "Failed to write " << FLAGS_output << std::endl;
     }
+    WriteTrace();
     std::cout << "Don't optimize me away! secret = " << pixels[0] << std::endl;
     delete[] pixels;
   }
@@ -0,0 +1,114 @@
+// Renders a keyframed timeline with the shader model, as PPM files or one
+// PPM stream, using every core by rendering many frames at once.  See
+// common/timeline.h for the format.
+//
+// Usage:
+//   ./render_timeline --timeline=morph.txt --output=frame%05d.ppm
+//   ./render_timeline --timeline=morph.txt --output=- |
+//       ffmpeg -f image2pipe -c:v ppm -i - morph.mp4
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include <gflags/gflags.h>
+
+#include "common/qc_params.h"
+#include "common/timeline.h"
+#include "common/trace.h"
+#include "image_io.h"
+#include "timeline_renderer.h"
+#include "worker_pool.h"
+
+DEFINE_string(timeline, "", "Timeline file to render.");
+DEFINE_int32(width, 640, "Width of the frames, unless the timeline sets it.");
+DEFINE_int32(height, 640,
+             "Height of the frames, unless the timeline sets it.");
+DEFINE_int32(num_waves, 7, "Number of waves before the first keyframe.");
+DEFINE_string(wavenumbers,
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2",
+              "Comma seperated list of per wave wavenumbers before the first "
+              "keyframe.");
+DEFINE_string(angular_frequencies,
+              "1.0, 0.9, 0.8, 0.7, 0.6,"
+              "0.5, 0.4, 0.3, 0.2, 0.1,"
+              "0.1, 0.2, 0.3, 0.4, 0.5",
+              "Comma seperated list of wave angular frequencies before the "
+              "first keyframe.");
+DEFINE_bool(antialias, true,
+            "Prefilter each wave over the pixel footprint.");
+DEFINE_double(shutter_angle, 0.0,
+              "If positive, blur the motion over this fraction of each frame "
+              "interval, in degrees out of 360, by averaging each wave over "
+              "it.  180 is typical of film.");
+DEFINE_int32(threads, 0, "Worker threads, 0 for one per hardware thread.");
+DEFINE_int32(frames_per_task, 0,
+             "Consecutive frames each worker takes at a time, 0 to choose "
+             "from the number of frames and threads.");
+DEFINE_string(output, "",
+              "If set, write frame n to the file named by this printf "
+              "pattern of n, such as frame%05d.ppm, or all frames to stdout "
+              "in order if it is -.");
+DEFINE_string(trace, "",
+              "If set, record when each part of every frame runs, on every "
+              "thread, and write it to this file on exit as Chrome trace "
+              "event JSON.");
+
+using namespace quasicrystal;
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  if (!FLAGS_trace.empty()) {
+    trace::Start();
+    trace::SetThreadName("main");
+  }
+  Timeline timeline;
+  if (!ReadTimeline(FLAGS_timeline,
+                    ParseQCParams(FLAGS_num_waves, FLAGS_angular_frequencies,
+                                  FLAGS_wavenumbers),
+                    &timeline)) {
+    std::cerr << "Failed to read timeline " << FLAGS_timeline << std::endl;
+    return 1;
+  }
+  const int width = timeline.width > 0 ? timeline.width : FLAGS_width;
+  const int height = timeline.height > 0 ? timeline.height : FLAGS_height;
+
+  RenderParams params;
+  params.antialias = FLAGS_antialias;
+  const TimelineRenderer renderer(timeline, width, height, params,
+                                  FLAGS_shutter_angle);
+  WorkerPool pool(FLAGS_threads);
+  bool written = true;
+  const auto start = std::chrono::steady_clock::now();
+  renderer.Render(&pool, [&](int frame, const float* pixels) {
+    if (FLAGS_output.empty()) {
+      return;
+    }
+    if (FLAGS_output == "-") {
+      written = WriteImage(std::cout, pixels, width, height, 3) && written;
+      return;
+    }
+    char filename[4096];
+    snprintf(filename, sizeof(filename), FLAGS_output.c_str(), frame);
+    written = WriteImage(filename, pixels, width, height, 3) && written;
+  }, FLAGS_frames_per_task);
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Rendered " << renderer.num_frames() << " frames of " << width
+            << "x" << height << " on " << pool.num_threads()
+            << " threads in " << seconds << " s, "
+            << renderer.num_frames() / seconds << " frames/s" << std::endl;
+
+  if (!FLAGS_trace.empty() && !trace::WriteJson(FLAGS_trace)) {
+    std::cerr << "Failed to write " << FLAGS_trace << std::endl;
+  }
+  if (!written) {
+    std::cerr << "Failed to write some frames to " << FLAGS_output
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
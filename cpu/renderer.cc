@@ -0,0 +1,518 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+#include <omp.h>
+
+#include "profile.h"
+#include "shader_model.h"
+#include "worker_pool.h"
+
+namespace quasicrystal {
+
+namespace {
+
+// Rows per band for the kernels that work row by row.  Small enough to give
+// every thread work on thumbnails, large enough to amortize per band setup.
+const int kRowBandHeight = 16;
+
+// Points per independently evaluated block of a PointBatch.
+const int kPointBlock = 4096;
+
+// Largest change in phase of any wave between neighbouring samples of the
+// wedge lattice, which bounds the error of interpolating on it.
+const double kWedgePhaseStep = 0.15;
+
+// Cost of interpolating a pixel from the wedge lattice, in sums of one wave
+// at one pixel, as measured with the simd kernel on 1920x1920 frames.
+const double kInterpolationWaves = 12.0;
+
+// Run task(0) ... task(n - 1) with OpenMP if pool is null, or on the pool.
+// If profile is not null, each task is recorded in it as one pass.
+void ParallelFor(int n, const std::function<void(int)>& task,
+                 WorkerPool* pool, FrameProfile* profile = nullptr) {
+  if (profile != nullptr) {
+    const int pass = profile->BeginPass();
+    ParallelFor(n, [&](int i) { profile->RunTask(pass, i, task); }, pool);
+  } else if (pool != nullptr) {
+    pool->Run(n, task);
+  } else {
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < n; ++i) {
+      task(i);
+    }
+  }
+}
+
+// Catmull-Rom weights of the samples at -1, 0, 1 and 2 for a point at
+// 0 <= f < 1.
+void CubicWeights(float f, float* weights) {
+  const float f2 = f * f;
+  const float f3 = f2 * f;
+  weights[0] = 0.5f * (-f3 + 2.0f * f2 - f);
+  weights[1] = 0.5f * (3.0f * f3 - 5.0f * f2 + 2.0f);
+  weights[2] = 0.5f * (-3.0f * f3 + 4.0f * f2 + f);
+  weights[3] = 0.5f * (f3 - f2);
+}
+
+// Distance from (center_x, center_y) to the furthest pixel of a viewport.
+double ViewportRadius(const Viewport& viewport, double center_x,
+                      double center_y) {
+  double radius = 0.0;
+  for (int corner = 0; corner < 4; ++corner) {
+    const double x = viewport.x + (corner & 1 ? viewport.width - 1 : 0);
+    const double y = viewport.y + (corner & 2 ? viewport.height - 1 : 0);
+    radius = std::max(radius, std::hypot(x - center_x, y - center_y));
+  }
+  return radius;
+}
+
+}  // namespace
+
+int NumChannels(ColorMode color) {
+  return color == kRotorColor ? 3 : 1;
+}
+
+void ApplyColor(ColorMode color, const float* sums, int n, float* out) {
+  if (color == kGrayColor) {
+    for (int i = 0; i < n; ++i) {
+      out[i] = 0.5f * (std::cos(static_cast<float>(M_PI) * sums[i]) + 1.0f);
+    }
+  } else {
+    RotorColor(sums, n, out);
+  }
+}
+
+Renderer::Renderer(const WaveTable& waves, const RenderParams& params)
+    : waves_(waves), params_(params) {
+  if (params_.antialias) {
+    ApplyPixelFilter(&waves_);
+  }
+  if (params_.shutter != 0.0f) {
+    ApplyMotionBlur(params_.shutter, &waves_);
+  }
+}
+
+void Renderer::Render(float t, const Viewport& viewport, float* out) const {
+  RenderOn(t, viewport, out, nullptr, nullptr, RowFunction());
+}
+
+void Renderer::Render(float t, const Viewport& viewport, float* out,
+                      WorkerPool* pool) const {
+  RenderOn(t, viewport, out, pool, nullptr, RowFunction());
+}
+
+void Renderer::Render(float t, const Viewport& viewport, float* out,
+                      WorkerPool* pool, const Exposure& exposure,
+                      FrameStats* stats, FrameProfile* profile) const {
+  if (profile != nullptr) {
+    profile->Begin(pool != nullptr ? pool->num_threads() :
+                                     omp_get_max_threads(),
+                   static_cast<long long>(viewport.width) * viewport.height);
+  }
+  if (stats == nullptr && exposure.IsIdentity()) {
+    RenderOn(t, viewport, out, pool, profile, RowFunction());
+  } else {
+    // Bands start at multiples of slot_height and are at least that tall,
+    // so this has a slot for every band, and merging the slots in order
+    // gives the same result for any number of threads.
+    const int c = channels();
+    const int slot_height = std::min(BandHeight(), kRowBandHeight);
+    std::vector<FrameStats> band_stats(
+        stats == nullptr ? 0 :
+        (viewport.height + slot_height - 1) / slot_height);
+    RenderOn(t, viewport, out, pool, profile, [&](int y, int height) {
+      float* rows = out + y * viewport.width * c;
+      const int n = height * viewport.width * c;
+      if (stats != nullptr) {
+        band_stats[y / slot_height].Add(rows, n);
+      }
+      if (!exposure.IsIdentity()) {
+        exposure.Apply(rows, n);
+      }
+    });
+    if (stats != nullptr) {
+      *stats = FrameStats();
+      for (const FrameStats& band : band_stats) {
+        stats->Merge(band);
+      }
+    }
+  }
+  if (profile != nullptr) {
+    profile->End();
+  }
+}
+
+void Renderer::Evaluate(const PointBatch& points, float* values,
+                        float* grad_x, float* grad_y) const {
+  Evaluate(points, values, grad_x, grad_y, nullptr);
+}
+
+void Renderer::Evaluate(const PointBatch& points, float* values,
+                        float* grad_x, float* grad_y,
+                        WorkerPool* pool) const {
+  const int num_blocks = (points.size + kPointBlock - 1) / kPointBlock;
+  ParallelFor(num_blocks, [&](int block) {
+    EvaluateBlock(points, block, values, grad_x, grad_y);
+  }, pool);
+}
+
+int Renderer::BandHeight() const {
+  if (params_.band_height > 0) {
+    return params_.band_height;
+  }
+  // NUFFT tiles are square, so anything shorter wastes work.
+  return params_.kernel == kNufftKernel ? kNufftTile : kRowBandHeight;
+}
+
+void Renderer::RenderBand(float t, const Viewport& viewport, int band,
+                          float* out) const {
+  const int y = band * BandHeight();
+  const int height = std::min(BandHeight(), viewport.height - y);
+  const int num_pixels = viewport.width * height;
+  float* band_out = out + y * viewport.width * channels();
+
+  if (params_.color == kGrayColor) {
+    SumWaves(params_.kernel, waves_, t, viewport.x, viewport.y + y,
+             viewport.width, height, band_out, viewport.width);
+    ApplyColor(kGrayColor, band_out, num_pixels, band_out);
+  } else {
+    // Sums go to per thread scratch space first, which is reused across
+    // frames and renderers.
+    static thread_local std::vector<float> sums;
+    sums.resize(num_pixels);
+    SumWaves(params_.kernel, waves_, t, viewport.x, viewport.y + y,
+             viewport.width, height, sums.data(), viewport.width);
+    ApplyColor(kRotorColor, sums.data(), num_pixels, band_out);
+  }
+}
+
+void Renderer::RenderOn(float t, const Viewport& viewport, float* out,
+                        WorkerPool* pool, FrameProfile* profile,
+                        const RowFunction& finish) const {
+  if (params_.symmetry != kNoSymmetry) {
+    // Symmetries are found on the waves as rendered, so the pixel filter
+    // keeps those of the grid and usually breaks the others.  A wedge needs
+    // at least two mirrors to bound it.
+    const double radius =
+        ViewportRadius(viewport, waves_.center_x, waves_.center_y);
+    const MirrorFold fold(waves_, t, radius);
+    DihedralSymmetry symmetry;
+    if (params_.symmetry == kFullSymmetry &&
+        FindSymmetry(waves_, t, radius, &symmetry) && symmetry.order >= 2) {
+      RenderWedge(t, viewport, symmetry, fold, finish, out, pool, profile);
+      return;
+    }
+    if (fold.size() > 1) {
+      RenderFolded(viewport, fold,
+                   [&](int x0, int y0, int width, int height, float* sums,
+                       int stride) {
+                     SumWaves(params_.kernel, waves_, t, x0, y0, width,
+                              height, sums, stride);
+                   }, finish, out, pool, profile);
+      return;
+    }
+  }
+  const int band_height = BandHeight();
+  const int num_bands = (viewport.height + band_height - 1) / band_height;
+  ParallelFor(num_bands, [&](int band) {
+    RenderBand(t, viewport, band, out);
+    if (finish) {
+      const int y = band * band_height;
+      finish(y, std::min(band_height, viewport.height - y));
+    }
+  }, pool, profile);
+}
+
+void Renderer::RenderFolded(const Viewport& viewport, const MirrorFold& fold,
+                            const SumFunction& sum,
+                            const RowFunction& finish, float* out,
+                            WorkerPool* pool, FrameProfile* profile) const {
+  const int c = channels();
+  const int band_height = BandHeight();
+
+  // The representatives of the viewport's pixels are the representatives
+  // that lie in one of its images, so render those, one region per
+  // distinct image.  Regions are stored whole but rendered in bands, each
+  // trimmed on the left to its first representative.
+  struct Region {
+    int x0, y0, x1, y1;
+    std::vector<int> band_x0;
+    std::vector<float> pixels;
+  };
+  std::vector<Region> regions;
+  std::vector<int> region_of_map(fold.size());
+  for (int i = 0; i < fold.size(); ++i) {
+    int ax, ay, bx, by;
+    fold.Map(i, viewport.x, viewport.y, &ax, &ay);
+    fold.Map(i, viewport.x + viewport.width - 1,
+             viewport.y + viewport.height - 1, &bx, &by);
+    Region region;
+    region.x0 = std::min(ax, bx);
+    region.y0 = std::min(ay, by);
+    region.x1 = std::max(ax, bx) + 1;
+    region.y1 = std::max(ay, by) + 1;
+    int r = 0;
+    while (r < static_cast<int>(regions.size()) &&
+           (regions[r].x0 != region.x0 || regions[r].y0 != region.y0 ||
+            regions[r].x1 != region.x1 || regions[r].y1 != region.y1)) {
+      ++r;
+    }
+    if (r == static_cast<int>(regions.size())) {
+      regions.push_back(region);
+    }
+    region_of_map[i] = r;
+  }
+
+  struct BandTask {
+    int region;
+    int band;
+  };
+  std::vector<BandTask> tasks;
+  long long num_representatives = 0;
+  for (int r = 0; r < static_cast<int>(regions.size()); ++r) {
+    Region& region = regions[r];
+    for (int y = region.y0; y < region.y1; y += band_height) {
+      const int y_end = std::min(y + band_height, region.y1);
+      int x0 = region.x1;
+      for (int j = y; j < y_end; ++j) {
+        x0 = std::min(x0, fold.FirstRepresentative(j, region.x0, x0));
+      }
+      region.band_x0.push_back(x0);
+      tasks.push_back({r, static_cast<int>(region.band_x0.size()) - 1});
+      num_representatives += (region.x1 - x0) * (y_end - y);
+    }
+  }
+  // Folding and copying cost about as much as summing a few waves, so only
+  // fold when it saves a good part of the viewport.
+  if (num_representatives >
+      0.75 * viewport.width * static_cast<double>(viewport.height)) {
+    const int num_bands = (viewport.height + band_height - 1) / band_height;
+    ParallelFor(num_bands, [&](int band) {
+      const int y = band * band_height;
+      const int height = std::min(band_height, viewport.height - y);
+      RenderRect(sum, viewport.x, viewport.y + y, viewport.width, height,
+                 out + y * viewport.width * c, viewport.width);
+      if (finish) {
+        finish(y, height);
+      }
+    }, pool, profile);
+    return;
+  }
+  for (Region& region : regions) {
+    region.pixels.resize(static_cast<size_t>(region.x1 - region.x0) *
+                         (region.y1 - region.y0) * c);
+  }
+
+  ParallelFor(static_cast<int>(tasks.size()), [&](int task) {
+    Region& region = regions[tasks[task].region];
+    const int band = tasks[task].band;
+    const int x0 = region.band_x0[band];
+    const int y0 = region.y0 + band * band_height;
+    const int stride = region.x1 - region.x0;
+    RenderRect(sum, x0, y0, region.x1 - x0,
+               std::min(band_height, region.y1 - y0),
+               region.pixels.data() +
+               ((y0 - region.y0) * stride + x0 - region.x0) * c, stride);
+  }, pool, profile);
+
+  const int num_bands = (viewport.height + kRowBandHeight - 1) /
+                        kRowBandHeight;
+  ParallelFor(num_bands, [&](int band) {
+    static thread_local std::vector<MirrorFold::Run> runs;
+    const int y_end = std::min((band + 1) * kRowBandHeight, viewport.height);
+    for (int j = band * kRowBandHeight; j < y_end; ++j) {
+      fold.FoldRow(viewport.x, viewport.y + j, viewport.width, &runs);
+      float* row = out + (j * viewport.width - viewport.x) * c;
+      for (const MirrorFold::Run& run : runs) {
+        const Region& region = regions[region_of_map[run.map]];
+        const int stride = region.x1 - region.x0;
+        const float* pixel = region.pixels.data() +
+            ((run.folded_y - region.y0) * stride +
+             run.folded_x - region.x0) * c;
+        const int step = (run.step_y * stride + run.step_x) * c;
+        float* dest = row + run.x * c;
+        if (c == 1) {
+          for (int i = 0; i < run.length; ++i) {
+            dest[i] = pixel[i * step];
+          }
+        } else {
+          for (int i = 0; i < run.length; ++i) {
+            for (int k = 0; k < c; ++k) {
+              dest[i * c + k] = pixel[i * step + k];
+            }
+          }
+        }
+      }
+    }
+    if (finish) {
+      finish(band * kRowBandHeight, y_end - band * kRowBandHeight);
+    }
+  }, pool, profile);
+}
+
+void Renderer::RenderWedge(float t, const Viewport& viewport,
+                           const DihedralSymmetry& symmetry,
+                           const MirrorFold& fold,
+                           const RowFunction& finish, float* out,
+                           WorkerPool* pool, FrameProfile* profile) const {
+  const WedgeFold wedge(symmetry);
+
+  // Space the lattice so that no wave turns by more than kWedgePhaseStep
+  // between samples, but never more finely than the pixels.
+  double wavenumber = 0.0;
+  int num_waves = 0;
+  for (int w = 0; w < waves_.size(); ++w) {
+    if (waves_.amplitude[w] != 0.0f) {
+      ++num_waves;
+      wavenumber = std::max(
+          wavenumber, std::hypot(static_cast<double>(waves_.kx[w]),
+                                 static_cast<double>(waves_.ky[w])));
+    }
+  }
+  const double spacing =
+      wavenumber > 0.0 ? std::min(1.0, kWedgePhaseStep / wavenumber) : 1.0;
+
+  // The wedge out to the furthest corner of the viewport, with a margin of
+  // two samples on every side for the interpolation.  Lattice row i is at
+  // s = (i - 2) * spacing, and column j at q = (j - 2) * spacing, out to
+  // two samples beyond the edge of the wedge at the next row but one.
+  const double radius =
+      ViewportRadius(viewport, symmetry.center_x, symmetry.center_y);
+  const double slope = std::tan(wedge.angle());
+  const int num_rows = static_cast<int>(std::ceil(radius / spacing)) + 5;
+  std::vector<int> row_offset(num_rows + 1, 0);
+  for (int i = 0; i < num_rows; ++i) {
+    const int columns = static_cast<int>(std::ceil(i * slope)) + 5;
+    row_offset[i + 1] = row_offset[i] + columns;
+  }
+  const SumFunction kernel_sum =
+      [&](int x0, int y0, int width, int height, float* sums, int stride) {
+        SumWaves(params_.kernel, waves_, t, x0, y0, width, height, sums,
+                 stride);
+      };
+  // The fold leaves about one pixel in fold.size() to sum, and the wedge
+  // trades summing the waves there for summing them over the lattice and
+  // interpolating there, which only pays off with many waves.  When the
+  // center is far outside the viewport, the lattice alone can hold more
+  // samples than there are pixels.
+  const double folded_pixels =
+      viewport.width * static_cast<double>(viewport.height) / fold.size();
+  if (static_cast<double>(row_offset[num_rows]) * num_waves +
+          folded_pixels * kInterpolationWaves >=
+      folded_pixels * num_waves) {
+    RenderFolded(viewport, fold, kernel_sum, finish, out, pool, profile);
+    return;
+  }
+
+  std::vector<float> lattice(row_offset[num_rows]);
+  ParallelFor(num_rows, [&](int i) {
+    const int n = row_offset[i + 1] - row_offset[i];
+    static thread_local std::vector<float> x, y, times;
+    x.resize(n);
+    y.resize(n);
+    times.assign(n, t);
+    for (int j = 0; j < n; ++j) {
+      double px, py;
+      wedge.Unfold((i - 2) * spacing, (j - 2) * spacing, &px, &py);
+      x[j] = static_cast<float>(px);
+      y[j] = static_cast<float>(py);
+    }
+    SumWavesAtPoints(waves_, x.data(), y.data(), times.data(), n,
+                     lattice.data() + row_offset[i], nullptr, nullptr);
+  }, pool, profile);
+
+  const float inverse_spacing = static_cast<float>(1.0 / spacing);
+  const SumFunction interpolated_sum =
+      [&](int x0, int y0, int width, int height, float* sums, int stride) {
+        static thread_local std::vector<float> s, q;
+        s.resize(width);
+        q.resize(width);
+        for (int j = 0; j < height; ++j) {
+          wedge.FoldRow(x0, y0 + j, width, s.data(), q.data());
+          for (int i = 0; i < width; ++i) {
+            // Rounding can leave points just outside of the wedge.  Across
+            // the axis that is undone by the mirror there, elsewhere the
+            // margin of the lattice covers it.
+            const float ls = std::max(s[i] * inverse_spacing, 0.0f);
+            const float lq = std::abs(q[i]) * inverse_spacing;
+            const int row = static_cast<int>(ls);
+            const int column = static_cast<int>(lq);
+            float ws[4], wq[4];
+            CubicWeights(ls - row, ws);
+            CubicWeights(lq - column, wq);
+            float value = 0.0f;
+            for (int a = 0; a < 4; ++a) {
+              const float* samples =
+                  lattice.data() + row_offset[row + a + 1] + column + 1;
+              value += ws[a] * (wq[0] * samples[0] + wq[1] * samples[1] +
+                                wq[2] * samples[2] + wq[3] * samples[3]);
+            }
+            sums[j * stride + i] = value;
+          }
+        }
+      };
+  RenderFolded(viewport, fold, interpolated_sum, finish, out, pool,
+               profile);
+}
+
+void Renderer::RenderRect(const SumFunction& sum, int x0, int y0, int width,
+                          int height, float* out, int stride) const {
+  if (width == 0) {
+    return;
+  }
+  static thread_local std::vector<float> sums;
+  sums.resize(width * height);
+  sum(x0, y0, width, height, sums.data(), width);
+  const int c = channels();
+  for (int j = 0; j < height; ++j) {
+    ApplyColor(params_.color, sums.data() + j * width, width,
+               out + j * stride * c);
+  }
+}
+
+void Renderer::EvaluateBlock(const PointBatch& points, int block,
+                             float* values, float* grad_x,
+                             float* grad_y) const {
+  const int start = block * kPointBlock;
+  const int n = std::min(kPointBlock, points.size - start);
+  const int c = channels();
+  const bool gradient = grad_x != nullptr && grad_y != nullptr;
+
+  static thread_local std::vector<float> sums, sum_dx, sum_dy, derivatives;
+  sums.resize(n);
+  sum_dx.resize(n);
+  sum_dy.resize(n);
+  SumWavesAtPoints(waves_, points.x + start, points.y + start,
+                   points.t + start, n, sums.data(),
+                   gradient ? sum_dx.data() : nullptr,
+                   gradient ? sum_dy.data() : nullptr);
+
+  // Apply the color mapping, and the chain rule for gradients.
+  derivatives.resize(n * c);
+  if (params_.color == kGrayColor) {
+    const float pi = static_cast<float>(M_PI);
+    for (int i = 0; i < n; ++i) {
+      values[start + i] = 0.5f * (std::cos(pi * sums[i]) + 1.0f);
+      derivatives[i] = -0.5f * pi * std::sin(pi * sums[i]);
+    }
+  } else {
+    RotorColor(sums.data(), n, values + c * start);
+    if (gradient) {
+      RotorColorDerivative(sums.data(), n, derivatives.data());
+    }
+  }
+  if (gradient) {
+    for (int i = 0; i < n; ++i) {
+      for (int k = 0; k < c; ++k) {
+        grad_x[c * (start + i) + k] = derivatives[c * i + k] * sum_dx[i];
+        grad_y[c * (start + i) + k] = derivatives[c * i + k] * sum_dy[i];
+      }
+    }
+  }
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,180 @@
+// The quasicrystal rendering engine.  A Renderer is a plan for drawing one
+// configuration of waves: it owns the wave table and everything derived
+// from it, and keeps no per frame state, so any number of threads can render
+// different frames or viewports from the same Renderer at once.
+//
+// Example:
+//   RenderParams params;
+//   params.kernel = kRecurrenceKernel;
+//   Renderer renderer(MakeCrystalWaves(7, 0.2), params);
+//   std::vector<float> pixels(width * height * renderer.channels());
+//   renderer.Render(step, Viewport(0, 0, width, height), pixels.data());
+
+#ifndef QUASICRYSTAL_RENDERER_H
+#define QUASICRYSTAL_RENDERER_H
+
+#include <functional>
+
+#include "frame_stats.h"
+#include "symmetry.h"
+#include "wave_kernels.h"
+#include "wave_table.h"
+
+namespace quasicrystal {
+
+class FrameProfile;
+class WorkerPool;
+
+// How sums of waves are mapped to pixels.
+enum ColorMode {
+  // One channel, 0.5 * (cos(pi * p) + 1), as in the original cpu program.
+  kGrayColor,
+  // Three channels from the shader's rotor color mixer.
+  kRotorColor,
+};
+
+// Number of floats per pixel for a color mode.
+int NumChannels(ColorMode color);
+
+// Map n sums of waves to pixels.  For kGrayColor out may equal sums.
+void ApplyColor(ColorMode color, const float* sums, int n, float* out);
+
+struct RenderParams {
+  RenderParams()
+      : kernel(kSimdKernel),
+        antialias(false),
+        shutter(0.0f),
+        color(kGrayColor),
+        symmetry(kNoSymmetry),
+        band_height(0) {}
+  // Kernel used to sum the waves.
+  Kernel kernel;
+  // Prefilter the waves over the pixel footprint.
+  bool antialias;
+  // If not 0, prefilter the waves over this much time before each frame,
+  // for motion blur.  Negative when time runs backwards.
+  float shutter;
+  ColorMode color;
+  // Symmetry to exploit in frames that have it, as static frames usually
+  // do.  Frames without symmetry render as usual.  Symmetries are about the
+  // field origin, so they only save work when it is near the middle of the
+  // viewport, as in the shader model, and not at the corner, as in the cpu
+  // model.
+  SymmetryMode symmetry;
+  // Rows in each independently rendered band of a frame, or 0 for the
+  // kernel's default.  Taller bands have less per band overhead, shorter
+  // ones balance better over many threads.
+  int band_height;
+};
+
+// A rectangle of pixels, which may extend outside of any window.
+struct Viewport {
+  Viewport() : x(0), y(0), width(0), height(0) {}
+  Viewport(int x, int y, int width, int height)
+      : x(x), y(y), width(width), height(height) {}
+  int x, y;
+  int width, height;
+};
+
+// A batch of sample points, as a structure of arrays of size entries each.
+// Points are in the same pixel coordinates as viewports, so the value at
+// (i, j) is the value of pixel (i, j) in a rendered frame.
+struct PointBatch {
+  PointBatch() : x(nullptr), y(nullptr), t(nullptr), size(0) {}
+  const float* x;
+  const float* y;
+  const float* t;
+  int size;
+};
+
+class Renderer {
+ public:
+  Renderer(const WaveTable& waves, const RenderParams& params);
+
+  // Render the frame at time t over the viewport, into
+  // viewport.width * viewport.height * channels() floats at out, bottom row
+  // first.  The first form splits the work with OpenMP, the second runs it
+  // on a shared pool and blocks until it is done.  Both are thread-safe.
+  void Render(float t, const Viewport& viewport, float* out) const;
+  void Render(float t, const Viewport& viewport, float* out,
+              WorkerPool* pool) const;
+
+  // As above, on the pool or with OpenMP if pool is null, and also apply
+  // exposure to the pixels.  If stats is not null, it receives the
+  // statistics of the frame before exposure, measured band by band as the
+  // frame is rendered.  If profile is not null, it receives the times and
+  // hardware counts of the frame and of every task in it.
+  void Render(float t, const Viewport& viewport, float* out,
+              WorkerPool* pool, const Exposure& exposure,
+              FrameStats* stats, FrameProfile* profile = nullptr) const;
+
+  // Evaluate the field at a batch of points, writing channels() floats per
+  // point to values.  If grad_x and grad_y are not null, they receive the
+  // analytic derivatives of each channel with respect to x and y, in the
+  // same layout.  Always uses the simd kernel, and like Render either splits
+  // the work with OpenMP or runs it on a shared pool.  Thread-safe.
+  void Evaluate(const PointBatch& points, float* values,
+                float* grad_x = nullptr, float* grad_y = nullptr) const;
+  void Evaluate(const PointBatch& points, float* values, float* grad_x,
+                float* grad_y, WorkerPool* pool) const;
+
+  // Number of floats per pixel in rendered frames.
+  int channels() const { return NumChannels(params_.color); }
+
+  const WaveTable& waves() const { return waves_; }
+  const RenderParams& params() const { return params_; }
+
+ private:
+  // Number of rows in each independently rendered band of the viewport.
+  int BandHeight() const;
+
+  // Render band number band of the viewport.
+  void RenderBand(float t, const Viewport& viewport, int band,
+                  float* out) const;
+
+  // Writes the sums of waves over the rectangle x0, y0, width, height to
+  // out, with the given row stride, like SumWaves.
+  typedef std::function<void(int x0, int y0, int width, int height,
+                             float* out, int stride)> SumFunction;
+
+  // Called on rows y, ..., y + height - 1 of the frame once they are
+  // final, with y a multiple of the band height, or of the smaller fixed
+  // height of the copy pass when folding.  May be empty.
+  typedef std::function<void(int y, int height)> RowFunction;
+
+  // Render the viewport from sums of waves over just one representative of
+  // each orbit of the grid symmetries, copying it to the others.
+  void RenderFolded(const Viewport& viewport, const MirrorFold& fold,
+                    const SumFunction& sum, const RowFunction& finish,
+                    float* out, WorkerPool* pool,
+                    FrameProfile* profile) const;
+
+  // Render the viewport by interpolating sums of waves on a lattice over
+  // the fundamental wedge, folded as above.
+  void RenderWedge(float t, const Viewport& viewport,
+                   const DihedralSymmetry& symmetry, const MirrorFold& fold,
+                   const RowFunction& finish, float* out,
+                   WorkerPool* pool, FrameProfile* profile) const;
+
+  // Render a rectangle from sums of waves, into out with the given row
+  // stride in pixels.
+  void RenderRect(const SumFunction& sum, int x0, int y0, int width,
+                  int height, float* out, int stride) const;
+
+  // Render with OpenMP if pool is null, or on the pool, recording the
+  // tasks in profile if it is not null.
+  void RenderOn(float t, const Viewport& viewport, float* out,
+                WorkerPool* pool, FrameProfile* profile,
+                const RowFunction& finish) const;
+
+  // Evaluate block number block of the points.
+  void EvaluateBlock(const PointBatch& points, int block, float* values,
+                     float* grad_x, float* grad_y) const;
+
+  WaveTable waves_;
+  RenderParams params_;
+};
+
+}  // namespace quasicrystal
+
+#endif
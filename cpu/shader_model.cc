@@ -0,0 +1,84 @@
+#include "shader_model.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "fast_math.h"
+
+namespace quasicrystal {
+
+namespace {
+
+// The value of pi used in qc.frag, which we match so that images agree.
+const float kShaderPi = 3.14159f;
+
+float Clamp(float v) {
+  return std::min(1.0f, std::max(0.0f, v));
+}
+
+}  // namespace
+
+WaveTable MakeShaderWaves(const QCParams& params, int width, int height) {
+  MixedWave mixed[kMaxNumWaves];
+  const int count = MixWaves(params, mixed);
+  WaveTable waves;
+  // The shader measures from the screen center to fragment centers.
+  waves.center_x = 0.5f * width - 0.5f;
+  waves.center_y = 0.5f * height - 0.5f;
+  for (int w = 0; w < count; ++w) {
+    waves.Add(mixed[w].kx, mixed[w].ky, 0.0f, mixed[w].angular_frequency,
+              0.5f * mixed[w].weight);
+    waves.bias += 0.5f * mixed[w].weight;
+  }
+  return waves;
+}
+
+void ApplyShaderView(float x, float y, float scale, WaveTable* waves) {
+  for (int i = 0; i < waves->size(); ++i) {
+    waves->phase[i] += waves->kx[i] * x + waves->ky[i] * y;
+    waves->kx[i] *= scale;
+    waves->ky[i] *= scale;
+  }
+}
+
+void RotorColor(const float* p, int n, float* rgb) {
+  // General Rotors patented color mixer, see qc.frag.
+  const float ga = 0.2f * kShaderPi;
+  const float k = 1.6f;
+  const float d = 0.7f;
+  const float cos_ga = std::cos(ga), sin_ga = std::sin(ga);
+  #pragma omp simd
+  for (int i = 0; i < n; ++i) {
+    const float cc = FastCos(kShaderPi * p[i]);
+    const float ss = FastCos(kShaderPi * p[i] - 0.5f * kShaderPi);
+    rgb[3 * i + 0] = Clamp(k * 0.5f * cc + d);
+    rgb[3 * i + 1] = Clamp(k * 0.5f * (cos_ga * cc + sin_ga * ss) + d);
+    rgb[3 * i + 2] = Clamp(k * 0.5f * ss + d);
+  }
+}
+
+void RotorColorDerivative(const float* p, int n, float* drgb) {
+  const float ga = 0.2f * kShaderPi;
+  const float k = 1.6f;
+  const float d = 0.7f;
+  const float cos_ga = std::cos(ga), sin_ga = std::sin(ga);
+  #pragma omp simd
+  for (int i = 0; i < n; ++i) {
+    const float cc = FastCos(kShaderPi * p[i]);
+    const float ss = FastCos(kShaderPi * p[i] - 0.5f * kShaderPi);
+    const float rgb[3] = {k * 0.5f * cc + d,
+                          k * 0.5f * (cos_ga * cc + sin_ga * ss) + d,
+                          k * 0.5f * ss + d};
+    // d cc / dp = -pi ss and d ss / dp = pi cc.
+    const float derivatives[3] = {
+        -k * 0.5f * kShaderPi * ss,
+        k * 0.5f * kShaderPi * (sin_ga * cc - cos_ga * ss),
+        k * 0.5f * kShaderPi * cc};
+    for (int c = 0; c < 3; ++c) {
+      const bool clamped = rgb[c] < 0.0f || rgb[c] > 1.0f;
+      drgb[3 * i + c] = clamped ? 0.0f : derivatives[c];
+    }
+  }
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,35 @@
+// A cpu implementation of the quasicrystal model drawn by shader/qc.frag,
+// so that frames designed in the shader viewer can be rendered without a
+// GPU.  All of the per frame work the shader repeats for every fragment
+// (mixing angles, angular frequencies and wavenumbers) is done once here,
+// producing a WaveTable that the usual kernels evaluate.
+
+#ifndef QUASICRYSTAL_SHADER_MODEL_H
+#define QUASICRYSTAL_SHADER_MODEL_H
+
+#include "common/qc_params.h"
+#include "wave_table.h"
+
+namespace quasicrystal {
+
+// Build the waves the shader sums for params on a width x height screen.
+// The table is independent of params.t, evaluate it at t = params.t to get
+// the shader's frame.
+WaveTable MakeShaderWaves(const QCParams& params, int width, int height);
+
+// Pan and zoom waves as the shader's view uniform does, so that the field
+// point (x, y) is at the screen center and each pixel spans scale field
+// units.
+void ApplyShaderView(float x, float y, float scale, WaveTable* waves);
+
+// Map n wave sums p to RGB triples with the shader's rotor color mixer,
+// clamped to [0, 1] like a framebuffer write.
+void RotorColor(const float* p, int n, float* rgb);
+
+// Derivatives of RotorColor with respect to p, which are zero wherever the
+// color is clamped.
+void RotorColorDerivative(const float* p, int n, float* drgb);
+
+}  // namespace quasicrystal
+
+#endif
@@ -0,0 +1,194 @@
+// Renders a grid of quasicrystal variants as thumbnails, for searching for
+// good looking configurations.  The grid is the product of the lists given
+// for each parameter.  Thumbnails go to a contact sheet with one row per
+// configuration and one column per time, and/or to a directory with one
+// file per variant and an index describing them.
+//
+// Usage:
+//   ./sweep --wave_counts=5,7,9 --freqs=0.1,0.2,0.3 --times=0,20,40
+//       --contact_sheet=sheet.pgm
+//   ./sweep --model=shader --wave_counts=7 --times=0,5
+//       --wavenumber_sets="0.2,0.2,0.2;0.1,0.2,0.3" --output_dir=thumbnails
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "common/qc_params.h"
+#include "image_io.h"
+#include "parameter_sweep.h"
+#include "shader_model.h"
+#include "wave_table.h"
+#include "worker_pool.h"
+
+DEFINE_string(model, "cpu",
+              "Quasicrystal model: cpu, swept over --freqs, or shader, swept "
+              "over --wavenumber_sets.");
+DEFINE_int32(width, 640, "Width of the full size frame thumbnails show.");
+DEFINE_int32(height, 640, "Height of the full size frame thumbnails show.");
+DEFINE_int32(thumbnail_width, 128, "Width of each thumbnail.");
+DEFINE_string(wave_counts, "7", "Comma separated numbers of waves.");
+DEFINE_string(freqs, "0.2", "Comma separated wave frequencies, cpu model.");
+DEFINE_string(wavenumber_sets,
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2",
+              "Semicolon separated sets of comma separated per wave "
+              "wavenumbers, shader model.  The last wavenumber of a set "
+              "carries on to the waves after it.");
+DEFINE_string(angular_frequencies,
+              "1.0, 0.9, 0.8, 0.7, 0.6,"
+              "0.5, 0.4, 0.3, 0.2, 0.1,"
+              "0.1, 0.2, 0.3, 0.4, 0.5",
+              "Comma seperated list of wave angular frequencies, shader "
+              "model.");
+DEFINE_string(times, "0", "Comma separated times to render each "
+              "configuration at, in steps for the cpu model.");
+DEFINE_bool(antialias, true,
+            "Prefilter waves over the thumbnail pixel footprint.");
+DEFINE_int32(threads, 0, "Worker threads, 0 for one per hardware thread.");
+DEFINE_string(contact_sheet, "",
+              "If set, write all thumbnails to this PGM or PPM file.");
+DEFINE_string(output_dir, "",
+              "If set, write each thumbnail to this existing directory.");
+
+using namespace quasicrystal;
+
+namespace {
+
+std::vector<float> SplitFloats(const std::string& str) {
+  std::vector<float> values;
+  for (const std::string& part : Split(str, ',')) {
+    values.push_back(atof(part.c_str()));
+  }
+  return values;
+}
+
+// Lay the thumbnails out in rows of columns, top to bottom, with a one
+// pixel black border around each.
+std::vector<float> MakeContactSheet(const ParameterSweep& sweep,
+                                    const std::vector<float>& thumbnails,
+                                    int columns, int* sheet_width,
+                                    int* sheet_height) {
+  const int rows = (sweep.num_variants() + columns - 1) / columns;
+  const int c = sweep.channels();
+  const int cell_width = sweep.width() + 1;
+  const int cell_height = sweep.height() + 1;
+  *sheet_width = columns * cell_width + 1;
+  *sheet_height = rows * cell_height + 1;
+  std::vector<float> sheet(*sheet_width * *sheet_height * c, 0.0f);
+  for (int i = 0; i < sweep.num_variants(); ++i) {
+    // Sheet rows are stored bottom first, like the thumbnails.
+    const int x0 = (i % columns) * cell_width + 1;
+    const int y0 = (rows - 1 - i / columns) * cell_height + 1;
+    for (int y = 0; y < sweep.height(); ++y) {
+      const float* src =
+          &thumbnails[i * sweep.thumbnail_size() + y * sweep.width() * c];
+      std::copy(src, src + sweep.width() * c,
+                &sheet[((y0 + y) * *sheet_width + x0) * c]);
+    }
+  }
+  return sheet;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  const bool shader_model = FLAGS_model == "shader";
+  if (FLAGS_model != "cpu" && !shader_model) {
+    std::cout << "Unknown model " << FLAGS_model << std::endl;
+    return 1;
+  }
+
+  const float pixel_size =
+      static_cast<float>(FLAGS_width) / FLAGS_thumbnail_width;
+  const int thumbnail_height =
+      std::max(1, static_cast<int>(FLAGS_height / pixel_size + 0.5f));
+  ParameterSweep sweep(FLAGS_thumbnail_width, thumbnail_height,
+                       shader_model ? kRotorColor : kGrayColor);
+
+  // Enumerate the grid, with times varying fastest so they share tables.
+  const std::vector<float> times = SplitFloats(FLAGS_times);
+  std::vector<std::string> descriptions;
+  for (const std::string& count : Split(FLAGS_wave_counts, ',')) {
+    const int num_waves = atoi(count.c_str());
+    const std::vector<std::string> configurations = shader_model ?
+        Split(FLAGS_wavenumber_sets, ';') : Split(FLAGS_freqs, ',');
+    for (const std::string& configuration : configurations) {
+      WaveTable waves;
+      if (shader_model) {
+        QCParams params = ParseQCParams(
+            num_waves, FLAGS_angular_frequencies, configuration);
+        const int given = std::min<int>(SplitFloats(configuration).size(),
+                                        kMaxNumWaves);
+        if (given > 0) {
+          std::fill(params.wavenumbers + given,
+                    params.wavenumbers + kMaxNumWaves,
+                    params.wavenumbers[given - 1]);
+        }
+        waves = MakeShaderWaves(params, FLAGS_width, FLAGS_height);
+      } else {
+        waves = MakeCrystalWaves(num_waves, atof(configuration.c_str()));
+      }
+      ScaleWaves(pixel_size, &waves);
+      if (FLAGS_antialias) {
+        ApplyPixelFilter(&waves);
+      }
+      for (float t : times) {
+        sweep.AddVariant(waves, t);
+        std::ostringstream description;
+        description << "num_waves=" << num_waves
+                    << (shader_model ? " wavenumbers=" : " freq=")
+                    << configuration << " t=" << t;
+        descriptions.push_back(description.str());
+      }
+    }
+  }
+
+  WorkerPool pool(FLAGS_threads);
+  std::vector<float> thumbnails;
+  auto start = std::chrono::steady_clock::now();
+  sweep.Render(&pool, &thumbnails);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  printf("Rendered %d thumbnails of %dx%d in %d groups in %.3f s, "
+         "%.1f thumbnails/s\n", sweep.num_variants(), sweep.width(),
+         sweep.height(), sweep.num_groups(), elapsed.count(),
+         sweep.num_variants() / elapsed.count());
+
+  if (!FLAGS_contact_sheet.empty()) {
+    int sheet_width, sheet_height;
+    std::vector<float> sheet = MakeContactSheet(
+        sweep, thumbnails, std::max<int>(1, times.size()),
+        &sheet_width, &sheet_height);
+    if (!WriteImage(FLAGS_contact_sheet, sheet.data(), sheet_width,
+                    sheet_height, sweep.channels())) {
+      std::cout << "Failed to write " << FLAGS_contact_sheet << std::endl;
+      return 1;
+    }
+  }
+  if (!FLAGS_output_dir.empty()) {
+    std::ofstream index(FLAGS_output_dir + "/index.txt");
+    for (int i = 0; i < sweep.num_variants(); ++i) {
+      char filename[32];
+      snprintf(filename, sizeof(filename), "thumbnail_%05d.%s", i,
+               sweep.channels() == 3 ? "ppm" : "pgm");
+      if (!WriteImage(FLAGS_output_dir + "/" + filename,
+                      &thumbnails[i * sweep.thumbnail_size()], sweep.width(),
+                      sweep.height(), sweep.channels())) {
+        std::cout << "Failed to write " << filename << std::endl;
+        return 1;
+      }
+      index << filename << " " << descriptions[i] << "\n";
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,343 @@
+#include "symmetry.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace quasicrystal {
+
+namespace {
+
+// Whether the center of a table is on the half pixel lattice, tolerance in
+// pixels.
+const double kCenterTolerance = 1e-4;
+
+// Relative differences between waves that are within the rounding of a
+// float table, and so are shared by every kernel's sums anyway.
+const double kRoundingSlack = 4.0 * FLT_EPSILON;
+
+// How much of deviation, a difference in a quantity of size scale, is more
+// than rounding.
+double Excess(double deviation, double scale) {
+  return std::max(0.0, deviation - kRoundingSlack * scale);
+}
+
+// The sum over waves of amplitude times the phase of each wave at time t
+// and the center, as an angle in (-pi, pi].  A bound on how much the waves
+// differ from their values with all phases zero.
+double PhaseError(const WaveTable& waves, float t) {
+  double error = 0.0;
+  for (int w = 0; w < waves.size(); ++w) {
+    const double phase =
+        waves.phase[w] + static_cast<double>(waves.omega[w]) * t;
+    error += std::abs(waves.amplitude[w]) *
+             std::abs(std::remainder(phase, 2.0 * M_PI));
+  }
+  return error;
+}
+
+}  // namespace
+
+bool ParseSymmetryMode(const std::string& name, SymmetryMode* mode) {
+  if (name == "none") {
+    *mode = kNoSymmetry;
+  } else if (name == "mirror") {
+    *mode = kMirrorSymmetry;
+  } else if (name == "full") {
+    *mode = kFullSymmetry;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool FindSymmetry(const WaveTable& waves, float t, double radius,
+                  DihedralSymmetry* symmetry) {
+  std::vector<int> active;
+  for (int w = 0; w < waves.size(); ++w) {
+    if (waves.amplitude[w] != 0.0f) {
+      active.push_back(w);
+    }
+  }
+  const int n = static_cast<int>(active.size());
+  if (n == 0) {
+    return false;
+  }
+  double error = PhaseError(waves, t);
+
+  // Each wave's offset from the nearest multiple of pi / n, as a fraction
+  // of pi / n, which is the same for all waves of an evenly spaced set.
+  // cos is even, so directions only matter up to a half turn.
+  std::vector<double> slots(n);
+  double mean_cos = 0.0, mean_sin = 0.0;
+  double amplitude = 0.0, wavenumber = 0.0;
+  for (int i = 0; i < n; ++i) {
+    const int w = active[i];
+    slots[i] = n * std::atan2(waves.ky[w], waves.kx[w]) / M_PI;
+    mean_cos += std::cos(2.0 * M_PI * slots[i]);
+    mean_sin += std::sin(2.0 * M_PI * slots[i]);
+    amplitude += waves.amplitude[w] / static_cast<double>(n);
+    wavenumber += std::hypot(waves.kx[w], waves.ky[w]) / n;
+  }
+  const double offset = std::atan2(mean_sin, mean_cos) / (2.0 * M_PI);
+
+  // Every slot must be taken once, and the distance of each wave from its
+  // ideal direction, wavenumber and amplitude adds to the error.
+  std::vector<bool> taken(n, false);
+  for (int i = 0; i < n; ++i) {
+    const int w = active[i];
+    const double nearest = std::round(slots[i] - offset);
+    int slot = static_cast<int>(nearest) % n;
+    if (slot < 0) {
+      slot += n;
+    }
+    if (taken[slot]) {
+      return false;
+    }
+    taken[slot] = true;
+    const double angle_error = std::abs(slots[i] - offset - nearest) * M_PI / n;
+    const double wavenumber_error =
+        std::abs(std::hypot(waves.kx[w], waves.ky[w]) - wavenumber);
+    error += std::abs(waves.amplitude[w]) * radius *
+             (wavenumber * Excess(angle_error, 1.0) +
+              Excess(wavenumber_error, wavenumber));
+    error += Excess(std::abs(waves.amplitude[w] - amplitude), amplitude);
+  }
+  if (error > kMaxSymmetryError) {
+    return false;
+  }
+  const double axis = offset * M_PI / n;
+  symmetry->order = n;
+  symmetry->axis = axis - M_PI / n * std::floor(axis / (M_PI / n));
+  symmetry->center_x = waves.center_x;
+  symmetry->center_y = waves.center_y;
+  return true;
+}
+
+MirrorFold::MirrorFold(const WaveTable& waves, float t, double radius)
+    : center_x2_(static_cast<int>(std::lround(2.0 * waves.center_x))),
+      center_y2_(static_cast<int>(std::lround(2.0 * waves.center_y))) {
+  const Orthogonal identity = {1, 0, 0, 1};
+  maps_.push_back(identity);
+  // Grid maps need the center on the half pixel lattice, and phases that
+  // vanish, since reflections and turns flip the sign of each wave's
+  // argument.
+  const double phase_error = PhaseError(waves, t);
+  if (std::abs(2.0 * waves.center_x - center_x2_) > kCenterTolerance ||
+      std::abs(2.0 * waves.center_y - center_y2_) > kCenterTolerance ||
+      phase_error > kMaxSymmetryError) {
+    return;
+  }
+  const Orthogonal candidates[] = {
+    {0, -1, 1, 0},
+    {-1, 0, 0, -1},
+    {0, 1, -1, 0},
+    {1, 0, 0, -1},
+    {0, 1, 1, 0},
+    {-1, 0, 0, 1},
+    {0, -1, -1, 0},
+  };
+  for (const Orthogonal& map : candidates) {
+    // Quarter turns and transposes swap the axes, so the center must sit
+    // the same way on both.
+    if (map.uv != 0 && (center_x2_ - center_y2_) % 2 != 0) {
+      continue;
+    }
+    // The map takes each wave to one with wavevector (uu kx + uv ky,
+    // vu kx + vv ky), which must be close to a wave of the table, up to
+    // sign.
+    double error = phase_error;
+    for (int w = 0; w < waves.size() && error <= kMaxSymmetryError; ++w) {
+      if (waves.amplitude[w] == 0.0f) {
+        continue;
+      }
+      const double amplitude = std::abs(waves.amplitude[w]);
+      const double kx = map.uu * waves.kx[w] + map.uv * waves.ky[w];
+      const double ky = map.vu * waves.kx[w] + map.vv * waves.ky[w];
+      const double wavenumber = std::hypot(kx, ky);
+      double best = INFINITY;
+      for (int image = 0; image < waves.size(); ++image) {
+        const double distance = std::min(
+            std::hypot(kx - waves.kx[image], ky - waves.ky[image]),
+            std::hypot(kx + waves.kx[image], ky + waves.ky[image]));
+        best = std::min(
+            best, amplitude * radius * Excess(distance, wavenumber) +
+                  Excess(std::abs(waves.amplitude[w] - waves.amplitude[image]),
+                         amplitude));
+      }
+      error += best;
+    }
+    if (error <= kMaxSymmetryError) {
+      maps_.push_back(map);
+    }
+  }
+}
+
+void MirrorFold::Map(int i, int x, int y, int* mapped_x,
+                     int* mapped_y) const {
+  // Work in doubled coordinates, which are integers.
+  const Orthogonal& map = maps_[i];
+  const int u = 2 * x - center_x2_;
+  const int v = 2 * y - center_y2_;
+  *mapped_x = (map.uu * u + map.uv * v + center_x2_) / 2;
+  *mapped_y = (map.vu * u + map.vv * v + center_y2_) / 2;
+}
+
+void MirrorFold::Fold(int x, int y, int* folded_x, int* folded_y,
+                      int* map) const {
+  const int u = 2 * x - center_x2_;
+  const int v = 2 * y - center_y2_;
+  int best_u = u, best_v = v, best = 0;
+  for (int i = 1; i < size(); ++i) {
+    const int mu = maps_[i].uu * u + maps_[i].uv * v;
+    const int mv = maps_[i].vu * u + maps_[i].vv * v;
+    if (mu > best_u || (mu == best_u && mv > best_v)) {
+      best_u = mu;
+      best_v = mv;
+      best = i;
+    }
+  }
+  *folded_x = (best_u + center_x2_) / 2;
+  *folded_y = (best_v + center_y2_) / 2;
+  *map = best;
+}
+
+int MirrorFold::FirstRepresentative(int y, int x_begin, int x_end) const {
+  // Whether a pixel in the row is a representative only ever changes from
+  // false to true along the row, so binary search for the change.
+  while (x_begin < x_end) {
+    const int x = x_begin + (x_end - x_begin) / 2;
+    int folded_x, folded_y, map;
+    Fold(x, y, &folded_x, &folded_y, &map);
+    if (map == 0 || (folded_x == x && folded_y == y)) {
+      x_end = x;
+    } else {
+      x_begin = x + 1;
+    }
+  }
+  return x_begin;
+}
+
+void MirrorFold::FoldRow(int x0, int y, int width,
+                         std::vector<Run>* runs) const {
+  // In doubled coordinates the row crosses u = 0, u = v and u = -v, so the
+  // pixels either side of those are where the map may change.
+  const int v = 2 * y - center_y2_;
+  std::vector<int> breaks;
+  breaks.push_back(x0);
+  breaks.push_back(x0 + width);
+  const int crossings[] = {center_x2_, center_x2_ + v, center_x2_ - v};
+  for (int crossing : crossings) {
+    // The pixel on or just before the line starts a run of one.
+    const int x = crossing >= 0 ? crossing / 2 : -((1 - crossing) / 2);
+    for (int b = x; b <= x + 1; ++b) {
+      if (b > x0 && b < x0 + width) {
+        breaks.push_back(b);
+      }
+    }
+  }
+  std::sort(breaks.begin(), breaks.end());
+  breaks.erase(std::unique(breaks.begin(), breaks.end()), breaks.end());
+
+  runs->clear();
+  for (size_t b = 0; b + 1 < breaks.size(); ++b) {
+    Run run;
+    run.x = breaks[b];
+    run.length = breaks[b + 1] - breaks[b];
+    Fold(run.x, y, &run.folded_x, &run.folded_y, &run.map);
+    run.step_x = maps_[run.map].uu;
+    run.step_y = maps_[run.map].vu;
+    runs->push_back(run);
+  }
+}
+
+WedgeFold::WedgeFold(const DihedralSymmetry& symmetry)
+    : symmetry_(symmetry),
+      angle_(0.5 * M_PI / symmetry.order),
+      axis_cos_(std::cos(symmetry.axis)),
+      axis_sin_(std::sin(symmetry.axis)) {
+  for (int k = 0; k < 2 * symmetry.order; ++k) {
+    turn_cos_.push_back(std::cos(-2.0 * k * angle_));
+    turn_sin_.push_back(std::sin(-2.0 * k * angle_));
+  }
+}
+
+void WedgeFold::Fold(double x, double y, double* s, double* q) const {
+  const double u = x - symmetry_.center_x;
+  const double v = y - symmetry_.center_y;
+  const double ss = u * axis_cos_ + v * axis_sin_;
+  const double qq = -u * axis_sin_ + v * axis_cos_;
+  // Rotate back by whole multiples of pi / n into [0, pi / n), then reflect
+  // the upper half of that across the wedge edge.
+  double phi = std::atan2(qq, ss);
+  if (phi < 0.0) {
+    phi += 2.0 * M_PI;
+  }
+  const int turns =
+      std::min(static_cast<int>(phi / (2.0 * angle_)), 2 * symmetry_.order - 1);
+  const double rs = ss * turn_cos_[turns] - qq * turn_sin_[turns];
+  const double rq = ss * turn_sin_[turns] + qq * turn_cos_[turns];
+  if (phi - turns * 2.0 * angle_ > angle_) {
+    // Reflect about the line at angle_, which maps angle a to 2 angle_ - a.
+    const double c = turn_cos_[1];
+    const double sn = -turn_sin_[1];
+    *s = rs * c + rq * sn;
+    *q = rs * sn - rq * c;
+  } else {
+    *s = rs;
+    *q = rq;
+  }
+}
+
+void WedgeFold::FoldRow(int x0, int y, int width, float* s,
+                        float* q) const {
+  // Where the row crosses the 2n mirror lines through the center, relative
+  // to x0.
+  const double v = y - symmetry_.center_y;
+  std::vector<double> crossings;
+  crossings.push_back(0.0);
+  crossings.push_back(width);
+  for (int k = 0; k < 2 * symmetry_.order; ++k) {
+    const double angle = symmetry_.axis + k * angle_;
+    const double dy = std::sin(angle);
+    if (std::abs(dy) > 1e-12) {
+      const double x = symmetry_.center_x + v * std::cos(angle) / dy - x0;
+      if (x > 0.0 && x < width) {
+        crossings.push_back(x);
+      }
+    }
+  }
+  std::sort(crossings.begin(), crossings.end());
+
+  for (size_t c = 0; c + 1 < crossings.size(); ++c) {
+    const int begin = static_cast<int>(std::ceil(crossings[c]));
+    const int end = std::min(static_cast<int>(std::ceil(crossings[c + 1])),
+                             width);
+    if (begin >= end) {
+      continue;
+    }
+    // The fold is one isometry over the segment, so find it from two
+    // points and step along the row.
+    double s0, q0, s1, q1;
+    Fold(x0 + begin, y, &s0, &q0);
+    if (end - begin > 1) {
+      Fold(x0 + end - 1, y, &s1, &q1);
+    } else {
+      s1 = s0;
+      q1 = q0;
+    }
+    const double ds = end - begin > 1 ? (s1 - s0) / (end - begin - 1) : 0.0;
+    const double dq = end - begin > 1 ? (q1 - q0) / (end - begin - 1) : 0.0;
+    for (int i = begin; i < end; ++i) {
+      s[i] = static_cast<float>(s0 + (i - begin) * ds);
+      q[i] = static_cast<float>(q0 + (i - begin) * dq);
+    }
+  }
+}
+
+void WedgeFold::Unfold(double s, double q, double* x, double* y) const {
+  *x = symmetry_.center_x + s * axis_cos_ - q * axis_sin_;
+  *y = symmetry_.center_y + s * axis_sin_ + q * axis_cos_;
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,140 @@
+// Symmetries of static quasicrystal frames.  When every wave has the same
+// wavenumber and amplitude, their directions are evenly spaced over a half
+// turn, and all phases vanish at time t, the frame has the dihedral symmetry
+// of a 2n-gon about the field origin.  A renderer then only needs to evaluate
+// a fundamental region and can fill in the rest:
+//   MirrorFold  the symmetries that map the pixel grid onto itself (flips,
+//               transposes and quarter turns), as exact index remapping.
+//   WedgeFold   the full symmetry group, folding every point into a wedge
+//               of angle pi / 2n, which is then resampled.
+//
+// Waves are rarely exactly symmetric in floating point, and some models,
+// like the shader's with its short pi, are only nearly so.  A symmetry is
+// accepted over a frame of a given radius when the waves are close enough
+// to it that no pixel moves by more than kMaxSymmetryError.
+
+#ifndef QUASICRYSTAL_SYMMETRY_H
+#define QUASICRYSTAL_SYMMETRY_H
+
+#include <string>
+#include <vector>
+
+#include "wave_table.h"
+
+namespace quasicrystal {
+
+// Bound on the change in any sum of waves from treating the waves as
+// symmetric, a small fraction of a gray level in any color mode.
+const double kMaxSymmetryError = 2.5e-4;
+
+// How much symmetry a renderer may exploit.
+enum SymmetryMode {
+  kNoSymmetry,
+  // Exact, only grid symmetries.
+  kMirrorSymmetry,
+  // Everything, with resampling.
+  kFullSymmetry,
+};
+
+// Convert a mode name, "none", "mirror" or "full", to a mode.  Returns
+// false for an unknown name.
+bool ParseSymmetryMode(const std::string& name, SymmetryMode* mode);
+
+// The dihedral group of a 2n-gon: rotations by multiples of pi / n, and
+// reflections about axes at angles axis + j pi / 2n.
+struct DihedralSymmetry {
+  DihedralSymmetry() : order(0), axis(0.0), center_x(0.0), center_y(0.0) {}
+  int order;
+  double axis;
+  // Center of symmetry, in pixel coordinates.
+  double center_x, center_y;
+};
+
+// Returns true and fills symmetry if the waves at time t have dihedral
+// symmetry, to within kMaxSymmetryError out to radius pixels from their
+// center.  Waves with zero amplitude are ignored.
+bool FindSymmetry(const WaveTable& waves, float t, double radius,
+                  DihedralSymmetry* symmetry);
+
+// The elements of a dihedral group that map the pixel grid onto itself.
+// Every orbit of pixels under them has one representative, the image
+// furthest along +u, then +v, from the center.  In each row the
+// representatives are a run of pixels that extends to the right.
+class MirrorFold {
+ public:
+  // The grid symmetries of the waves at time t, to within
+  // kMaxSymmetryError out to radius pixels from their center.  These are
+  // checked one by one, so they need not come from a dihedral group.
+  MirrorFold(const WaveTable& waves, float t, double radius);
+
+  // The number of grid symmetries, including the identity, which is map 0.
+  int size() const { return static_cast<int>(maps_.size()); }
+
+  // The image of pixel (x, y) under map i.
+  void Map(int i, int x, int y, int* mapped_x, int* mapped_y) const;
+
+  // The representative of the orbit of pixel (x, y), and the map to it.
+  void Fold(int x, int y, int* folded_x, int* folded_y, int* map) const;
+
+  // The first representative in row y with x_begin <= x < x_end, or x_end
+  // if there is none.
+  int FirstRepresentative(int y, int x_begin, int x_end) const;
+
+  // A run of pixels (x + i, y), 0 <= i < length, that fold with the same
+  // map, to (folded_x + i * step_x, folded_y + i * step_y).
+  struct Run {
+    int x, length;
+    int folded_x, folded_y;
+    int step_x, step_y;
+    int map;
+  };
+
+  // Split pixels (x0 + i, y), 0 <= i < width, into runs.  The map only
+  // changes where the row crosses the axes or diagonals through the
+  // center, so there are at most seven.
+  void FoldRow(int x0, int y, int width, std::vector<Run>* runs) const;
+
+ private:
+  // An orthogonal map of the grid, (u, v) -> (uu * u + uv * v,
+  // vu * u + vv * v), with entries in {-1, 0, 1}.
+  struct Orthogonal {
+    int uu, uv, vu, vv;
+  };
+
+  std::vector<Orthogonal> maps_;
+  // Twice the center, which is on the half pixel lattice when maps_ holds
+  // more than the identity.
+  int center_x2_, center_y2_;
+};
+
+// Folds points into the wedge between the mirror axis at symmetry.axis and
+// the next one, pi / 2n further counterclockwise.  Wedge coordinates (s, q)
+// are measured along and across the axis from the center.
+class WedgeFold {
+ public:
+  explicit WedgeFold(const DihedralSymmetry& symmetry);
+
+  // Wedge coordinates of the image of pixel coordinates (x, y).
+  void Fold(double x, double y, double* s, double* q) const;
+
+  // Fold pixels (x0 + i, y) for 0 <= i < width, which is cheaper than one
+  // at a time since the fold is affine between the mirror lines.
+  void FoldRow(int x0, int y, int width, float* s, float* q) const;
+
+  // Pixel coordinates of wedge coordinates (s, q).
+  void Unfold(double s, double q, double* x, double* y) const;
+
+  // Half angle of the wedge, pi / 2n.
+  double angle() const { return angle_; }
+
+ private:
+  DihedralSymmetry symmetry_;
+  double angle_;
+  double axis_cos_, axis_sin_;
+  // Rotations by -k pi / n for k in [0, 2n).
+  std::vector<double> turn_cos_, turn_sin_;
+};
+
+}  // namespace quasicrystal
+
+#endif
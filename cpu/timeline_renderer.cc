@@ -0,0 +1,118 @@
+#include "timeline_renderer.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <omp.h>
+
+#include "common/session.h"
+#include "common/trace.h"
+#include "shader_model.h"
+#include "worker_pool.h"
+
+namespace quasicrystal {
+
+namespace {
+
+// Most frames in one task, which bounds how many finished frames wait for
+// an earlier one to be handed back.
+const int kMaxFramesPerTask = 16;
+
+}  // namespace
+
+TimelineRenderer::TimelineRenderer(const Timeline& timeline, int width,
+                                   int height, const RenderParams& params,
+                                   double shutter_angle)
+    : timeline_(timeline),
+      width_(width),
+      height_(height),
+      params_(params),
+      shutter_angle_(shutter_angle) {
+  params_.color = kRotorColor;
+}
+
+void TimelineRenderer::Render(WorkerPool* pool, const FrameCallback& done,
+                              int frames_per_task) const {
+  const int n = num_frames();
+  if (frames_per_task <= 0) {
+    // A few tasks per worker, so that they finish together.
+    const int num_threads =
+        pool != nullptr ? pool->num_threads() : omp_get_max_threads();
+    frames_per_task = std::max(
+        1, std::min(kMaxFramesPerTask, n / (4 * num_threads)));
+  }
+  const int num_tasks = (n + frames_per_task - 1) / frames_per_task;
+
+  // Frames that finished before the next one to hand back.
+  std::mutex mutex;
+  std::map<int, std::vector<float>> finished;
+  int next = 0;
+  const auto run_task = [&](int task) {
+    // Each worker draws its frames alone.
+    omp_set_num_threads(1);
+    const int begin = task * frames_per_task;
+    RenderRange(begin, std::min(n, begin + frames_per_task),
+                [&](int frame, std::vector<float>* pixels) {
+      std::lock_guard<std::mutex> lock(mutex);
+      finished[frame].swap(*pixels);
+      while (!finished.empty() && finished.begin()->first == next) {
+        TRACE_SPAN("FrameDone");
+        done(next, finished.begin()->second.data());
+        finished.erase(finished.begin());
+        ++next;
+      }
+    });
+  };
+  if (pool != nullptr) {
+    pool->Run(num_tasks, run_task);
+  } else {
+    #pragma omp parallel for schedule(dynamic)
+    for (int task = 0; task < num_tasks; ++task) {
+      run_task(task);
+    }
+  }
+}
+
+void TimelineRenderer::RenderRange(
+    int begin, int end,
+    const std::function<void(int, std::vector<float>*)>& finished) const {
+  std::unique_ptr<Renderer> renderer;
+  QCParams current;
+  float current_shutter = 0.0f;
+  std::vector<float> pixels;
+  for (int frame = begin; frame < end; ++frame) {
+    const double seconds = frame / timeline_.fps;
+    QCParams params = EvaluateTimeline(timeline_, seconds);
+    const float t = params.t;
+    params.t = current.t;
+    // The wave time that passes while the shutter is open, which changes
+    // with the speed.
+    float shutter = 0.0f;
+    if (shutter_angle_ > 0.0) {
+      const double open = shutter_angle_ / 360.0 / timeline_.fps;
+      shutter = t - EvaluateTimeline(timeline_, seconds - open).t;
+    }
+    if (renderer == nullptr || shutter != current_shutter ||
+        !SameParams(params, current)) {
+      TRACE_SPAN("MakeShaderWaves");
+      const WaveTable waves = MakeShaderWaves(params, width_, height_);
+      RenderParams render_params = params_;
+      render_params.kernel = ChooseKernel(waves.size());
+      render_params.shutter = shutter;
+      renderer.reset(new Renderer(waves, render_params));
+      current = params;
+      current_shutter = shutter;
+    }
+    current.t = t;
+    pixels.resize(width_ * height_ * renderer->channels());
+    {
+      TRACE_SPAN("RenderFrame");
+      renderer->Render(t, Viewport(0, 0, width_, height_), pixels.data());
+    }
+    finished(frame, &pixels);
+  }
+}
+
+}  // namespace quasicrystal
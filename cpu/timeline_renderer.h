@@ -0,0 +1,65 @@
+// Renders every frame of a timeline with the shader model, spreading whole
+// frames rather than bands of one frame over the workers, which scales
+// better for long sequences since workers never wait on each other within a
+// frame.  Each task is a range of consecutive frames, which usually share
+// their waves, so a worker builds each wave table once for all of them.
+// Frames finish out of order and are handed back in order.
+//
+// Example:
+//   TimelineRenderer renderer(timeline, 1280, 720, params);
+//   renderer.Render(&pool, [&](int frame, const float* pixels) {
+//     WriteImage(out, pixels, 1280, 720, 3);
+//   });
+
+#ifndef QUASICRYSTAL_TIMELINE_RENDERER_H
+#define QUASICRYSTAL_TIMELINE_RENDERER_H
+
+#include <functional>
+#include <vector>
+
+#include "common/timeline.h"
+#include "renderer.h"
+
+namespace quasicrystal {
+
+class WorkerPool;
+
+class TimelineRenderer {
+ public:
+  // Called with each frame in order, width * height * 3 floats bottom row
+  // first, from whichever worker finished it, one call at a time.
+  typedef std::function<void(int frame, const float* pixels)> FrameCallback;
+
+  // Frames are width x height, rendered with params, apart from the color,
+  // which is always the shader's, the kernel, which is chosen for each
+  // number of waves, and the shutter.  If shutter_angle is positive, each
+  // frame is blurred over that much of the frame interval before it, in
+  // degrees out of 360.
+  TimelineRenderer(const Timeline& timeline, int width, int height,
+                   const RenderParams& params, double shutter_angle = 0.0);
+
+  // Render every frame on the pool, or with OpenMP if it is null, with
+  // frames_per_task consecutive frames in each task, or a number chosen for
+  // the number of threads if it is not positive, and block until all of
+  // them have been passed to done.
+  void Render(WorkerPool* pool, const FrameCallback& done,
+              int frames_per_task = 0) const;
+
+  int num_frames() const { return NumTimelineFrames(timeline_); }
+
+ private:
+  // Render frames [begin, end) on the calling thread, passing each to
+  // finished.
+  void RenderRange(int begin, int end,
+                   const std::function<void(int, std::vector<float>*)>&
+                       finished) const;
+
+  Timeline timeline_;
+  int width_, height_;
+  RenderParams params_;
+  double shutter_angle_;
+};
+
+}  // namespace quasicrystal
+
+#endif
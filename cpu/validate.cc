@@ -0,0 +1,360 @@
+// Checks the renderer's fast paths against a straightforward double
+// precision reference, for both the cpu model and the shader model.  For
+// each model, wave count, time and antialiasing setting it renders the frame
+// with every kernel and symmetry mode and reports the max and mean absolute
+// error and PSNR against the reference.  It also checks that each variant
+// gives bit identical frames on any number of threads, and when the frame
+// is rendered as tiles or bands of several sizes.  Needs no display, and
+// exits with a nonzero status if anything is out of tolerance.
+//
+// Usage:
+//   ./validate
+//   ./validate --width=1920 --height=1080 --wave_counts=7,13 --times=0,50
+//       --mixes=0.5
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "common/qc_params.h"
+#include "renderer.h"
+#include "shader_model.h"
+#include "symmetry.h"
+#include "wave_kernels.h"
+#include "wave_table.h"
+#include "worker_pool.h"
+
+DEFINE_int32(width, 320, "Width of the test frames.");
+DEFINE_int32(height, 240, "Height of the test frames.");
+DEFINE_string(wave_counts, "7,14,64",
+              "Comma separated numbers of waves.  The shader model skips "
+              "counts above 14.");
+DEFINE_string(times, "0,37.5",
+              "Comma separated times, in steps for the cpu model.");
+DEFINE_double(freq, 1.0 / 5.0, "Frequency of waves, cpu model.");
+DEFINE_string(wavenumbers,
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2",
+              "Comma seperated list of per wave wavenumbers, shader model.");
+DEFINE_string(angular_frequencies,
+              "1.0, 0.9, 0.8, 0.7, 0.6,"
+              "0.5, 0.4, 0.3, 0.2, 0.1,"
+              "0.1, 0.2, 0.3, 0.4, 0.5",
+              "Comma seperated list of wave angular frequencies, shader "
+              "model.");
+DEFINE_string(mixes, "0,0.3",
+              "Comma separated mixing parameters, shader model.  Only frames "
+              "without mixing are symmetric.");
+DEFINE_double(max_error, 1.0 / 255.0,
+              "Largest absolute error allowed in any pixel channel.");
+DEFINE_double(min_psnr, 60.0, "Smallest PSNR allowed, in dB.");
+DEFINE_string(threads, "1,2,3,8",
+              "Comma separated worker thread counts to compare.");
+
+using namespace quasicrystal;
+
+namespace {
+
+// The value of pi in qc.frag, which is part of the shader model.
+const double kShaderPi = 3.14159;
+
+double Clamp(double v) {
+  return std::min(1.0, std::max(0.0, v));
+}
+
+// One frame to check.
+struct Case {
+  bool shader_model;
+  int num_waves;
+  double t;
+  double mix;
+  bool antialias;
+};
+
+std::string CaseName(const Case& c) {
+  std::ostringstream name;
+  name << (c.shader_model ? "shader" : "cpu") << " waves=" << c.num_waves
+       << " t=" << c.t;
+  if (c.shader_model) {
+    name << " mix=" << c.mix;
+  }
+  name << (c.antialias ? " antialias" : "");
+  return name.str();
+}
+
+// The cpu model, straight from its definition: num_waves waves of
+// wavenumber freq at angles i pi / n about pixel (0, 0), moving at
+// 0.05 (i + 1) per step, each adding 0.5 (cos(...) + 1), shown in gray
+// as 0.5 (cos(pi p) + 1).
+std::vector<float> ReferenceCpuModel(const Case& c) {
+  std::vector<float> frame(FLAGS_width * FLAGS_height);
+  for (int j = 0; j < FLAGS_height; ++j) {
+    for (int i = 0; i < FLAGS_width; ++i) {
+      double p = 0.0;
+      for (int w = 0; w < c.num_waves; ++w) {
+        const double angle = w * M_PI / c.num_waves;
+        const double kx = FLAGS_freq * std::cos(angle);
+        const double ky = FLAGS_freq * std::sin(angle);
+        const double attenuation =
+            c.antialias ? Sinc(0.5 * kx) * Sinc(0.5 * ky) : 1.0;
+        p += 0.5 * (attenuation *
+                    std::cos(kx * i + ky * j + 0.05 * (w + 1) * c.t) + 1.0);
+      }
+      frame[j * FLAGS_width + i] = 0.5 * (std::cos(M_PI * p) + 1.0);
+    }
+  }
+  return frame;
+}
+
+// The shader model, following qc.frag line by line.
+std::vector<float> ReferenceShaderModel(const Case& c,
+                                        const QCParams& params) {
+  const int n = c.num_waves;
+  const double mix = params.mix;
+  std::vector<double> kx(n + 1), ky(n + 1), omega(n + 1), weight(n + 1);
+  for (int w = 0; w < n + 1; ++w) {
+    double angle = 0.0;
+    double wavenumber = params.wavenumbers[0];
+    omega[w] = params.angular_frequencies[0];
+    if (w > 0) {
+      angle = (1.0 - mix) * (w - 1) * kShaderPi / n +
+              mix * w * kShaderPi / (n + 1);
+      omega[w] = (1.0 - mix) * params.angular_frequencies[w - 1] +
+                 mix * params.angular_frequencies[w];
+      wavenumber = (1.0 - mix) * params.wavenumbers[w - 1] +
+                   mix * params.wavenumbers[w];
+    }
+    kx[w] = wavenumber * std::cos(angle);
+    ky[w] = wavenumber * std::sin(angle);
+    weight[w] = w == 1 ? mix : 1.0;
+  }
+
+  std::vector<float> frame(FLAGS_width * FLAGS_height * 3);
+  const double ga = 0.2 * kShaderPi, ba = 0.5 * kShaderPi;
+  for (int j = 0; j < FLAGS_height; ++j) {
+    // Fragment centers, from the screen center.
+    const double y = j + 0.5 - 0.5 * FLAGS_height;
+    for (int i = 0; i < FLAGS_width; ++i) {
+      const double x = i + 0.5 - 0.5 * FLAGS_width;
+      double p = 0.0;
+      for (int w = 0; w < n + 1; ++w) {
+        const double attenuation =
+            c.antialias ? Sinc(0.5 * kx[w]) * Sinc(0.5 * ky[w]) : 1.0;
+        p += weight[w] * 0.5 *
+             (attenuation * std::cos(kx[w] * x + ky[w] * y + omega[w] * c.t) +
+              1.0);
+      }
+      const double cc = std::cos(kShaderPi * p);
+      const double ss = std::sin(kShaderPi * p);
+      float* rgb = &frame[3 * (j * FLAGS_width + i)];
+      rgb[0] = Clamp(1.6 * 0.5 * cc + 0.7);
+      rgb[1] = Clamp(1.6 * 0.5 * (std::cos(ga) * cc + std::sin(ga) * ss) +
+                     0.7);
+      rgb[2] = Clamp(1.6 * 0.5 * (std::cos(ba) * cc + std::sin(ba) * ss) +
+                     0.7);
+    }
+  }
+  return frame;
+}
+
+// Render a frame as tiles of tile_width x tile_height.
+void RenderTiled(const Renderer& renderer, float t, int tile_width,
+                 int tile_height, WorkerPool* pool, float* out) {
+  const int c = renderer.channels();
+  std::vector<float> tile;
+  for (int y = 0; y < FLAGS_height; y += tile_height) {
+    for (int x = 0; x < FLAGS_width; x += tile_width) {
+      const Viewport viewport(x, y, std::min(tile_width, FLAGS_width - x),
+                              std::min(tile_height, FLAGS_height - y));
+      tile.resize(viewport.width * viewport.height * c);
+      renderer.Render(t, viewport, tile.data(), pool);
+      for (int j = 0; j < viewport.height; ++j) {
+        std::copy(&tile[j * viewport.width * c],
+                  &tile[(j + 1) * viewport.width * c],
+                  &out[((y + j) * FLAGS_width + x) * c]);
+      }
+    }
+  }
+}
+
+// Whether a kernel computes every pixel the same way wherever the viewport
+// starts.  The recurrence and NUFFT kernels anchor their approximations at
+// the viewport, so tiles change their rounding.
+bool IsTileInvariant(Kernel kernel) {
+  return kernel != kRecurrenceKernel && kernel != kNufftKernel;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  std::vector<int> thread_counts;
+  for (const std::string& count : Split(FLAGS_threads, ',')) {
+    thread_counts.push_back(std::max(1, atoi(count.c_str())));
+  }
+  std::vector<Case> cases;
+  for (int model = 0; model < 2; ++model) {
+    for (const std::string& count : Split(FLAGS_wave_counts, ',')) {
+      const int num_waves = atoi(count.c_str());
+      if (num_waves < 1 || (model == 1 && num_waves >= kMaxNumWaves)) {
+        continue;
+      }
+      const std::vector<std::string> mixes =
+          model == 1 ? Split(FLAGS_mixes, ',') :
+          std::vector<std::string>(1, "0");
+      for (const std::string& t : Split(FLAGS_times, ',')) {
+        for (const std::string& mix : mixes) {
+          for (int antialias = 0; antialias < 2; ++antialias) {
+            Case c;
+            c.shader_model = model == 1;
+            c.num_waves = num_waves;
+            c.t = atof(t.c_str());
+            c.mix = atof(mix.c_str());
+            c.antialias = antialias == 1;
+            cases.push_back(c);
+          }
+        }
+      }
+    }
+  }
+
+  // Every kernel, and the symmetric renderers on the default kernel.
+  struct Variant {
+    Kernel kernel;
+    SymmetryMode symmetry;
+  };
+  std::vector<Variant> variants;
+  for (int k = kDirectKernel; k <= kSeparableKernel; ++k) {
+    variants.push_back({static_cast<Kernel>(k), kNoSymmetry});
+  }
+  variants.push_back({kSimdKernel, kMirrorSymmetry});
+  variants.push_back({kSimdKernel, kFullSymmetry});
+
+  // Tilings of the frame, as odd sizes so that tiles straddle bands and
+  // blocks.
+  const int tile_sizes[][2] = {{FLAGS_width, 37}, {100, 61}, {53, 250}};
+  const int band_heights[] = {5, 64};
+
+  printf("%dx%d frames, tolerance max %.2e, PSNR %.1f dB\n", FLAGS_width,
+         FLAGS_height, FLAGS_max_error, FLAGS_min_psnr);
+  printf("%-36s %-18s %10s %10s %8s %8s %8s\n", "case", "variant",
+         "max err", "mean err", "PSNR", "threads", "tiles");
+  int failures = 0;
+  for (const Case& c : cases) {
+    QCParams params = ParseQCParams(c.num_waves, FLAGS_angular_frequencies,
+                                    FLAGS_wavenumbers);
+    params.mix = c.mix;
+    const std::vector<float> reference = c.shader_model ?
+        ReferenceShaderModel(c, params) : ReferenceCpuModel(c);
+    const WaveTable waves = c.shader_model ?
+        MakeShaderWaves(params, FLAGS_width, FLAGS_height) :
+        MakeCrystalWaves(c.num_waves, static_cast<float>(FLAGS_freq));
+
+    for (const Variant& variant : variants) {
+      RenderParams render_params;
+      render_params.kernel = variant.kernel;
+      render_params.symmetry = variant.symmetry;
+      render_params.antialias = c.antialias;
+      render_params.color = c.shader_model ? kRotorColor : kGrayColor;
+      const Renderer renderer(waves, render_params);
+      const float t = static_cast<float>(c.t);
+
+      // Accuracy, on one thread.
+      std::vector<float> frame(reference.size());
+      WorkerPool one_thread(1);
+      renderer.Render(t, Viewport(0, 0, FLAGS_width, FLAGS_height),
+                      frame.data(), &one_thread);
+      double max_error = 0.0, sum_error = 0.0, sum_squared_error = 0.0;
+      for (size_t i = 0; i < frame.size(); ++i) {
+        const double error = std::abs(frame[i] - reference[i]);
+        max_error = std::max(max_error, error);
+        sum_error += error;
+        sum_squared_error += error * error;
+      }
+      const double mse = sum_squared_error / frame.size();
+      const double psnr = mse > 0.0 ? -10.0 * std::log10(mse) : INFINITY;
+
+      // Determinism over thread counts, with OpenMP as one more.
+      std::vector<float> other(frame.size());
+      bool threads_identical = true;
+      for (int threads : thread_counts) {
+        WorkerPool pool(threads);
+        renderer.Render(t, Viewport(0, 0, FLAGS_width, FLAGS_height),
+                        other.data(), &pool);
+        threads_identical &=
+            memcmp(other.data(), frame.data(), 4 * frame.size()) == 0;
+      }
+      renderer.Render(t, Viewport(0, 0, FLAGS_width, FLAGS_height),
+                      other.data());
+      threads_identical &=
+          memcmp(other.data(), frame.data(), 4 * frame.size()) == 0;
+
+      // Tiles, which must match exactly where the kernel is tile
+      // invariant and the frame is not folded about its own center, and
+      // otherwise within the accuracy tolerance.
+      WorkerPool pool(thread_counts.back());
+      double tile_difference = 0.0;
+      for (const int* size : tile_sizes) {
+        RenderTiled(renderer, t, size[0], size[1], &pool, other.data());
+        for (size_t i = 0; i < frame.size(); ++i) {
+          tile_difference = std::max<double>(
+              tile_difference, std::abs(other[i] - frame[i]));
+        }
+      }
+      // Band heights the auto-tuner might pick tile the frame too.
+      for (int band_height : band_heights) {
+        RenderParams banded_params = render_params;
+        banded_params.band_height = band_height;
+        Renderer(waves, banded_params).Render(
+            t, Viewport(0, 0, FLAGS_width, FLAGS_height), other.data(),
+            &pool);
+        for (size_t i = 0; i < frame.size(); ++i) {
+          tile_difference = std::max<double>(
+              tile_difference, std::abs(other[i] - frame[i]));
+        }
+      }
+      const bool exact_tiles = IsTileInvariant(variant.kernel) &&
+                               variant.symmetry == kNoSymmetry;
+      const bool tiles_ok = exact_tiles ? tile_difference == 0.0 :
+                            tile_difference <= FLAGS_max_error;
+
+      const bool ok = max_error <= FLAGS_max_error &&
+                      psnr >= FLAGS_min_psnr && threads_identical &&
+                      tiles_ok;
+      failures += !ok;
+      std::string variant_name = KernelName(variant.kernel);
+      if (variant.symmetry == kMirrorSymmetry) {
+        variant_name += "+mirror";
+      } else if (variant.symmetry == kFullSymmetry) {
+        variant_name += "+full";
+      }
+      char tiles[16];
+      if (tile_difference == 0.0) {
+        snprintf(tiles, sizeof(tiles), "same");
+      } else {
+        snprintf(tiles, sizeof(tiles), "%.1e", tile_difference);
+      }
+      printf("%-36s %-18s %10.2e %10.2e %8.1f %8s %8s%s\n",
+             CaseName(c).c_str(), variant_name.c_str(), max_error,
+             sum_error / frame.size(), psnr,
+             threads_identical ? "same" : "DIFFER", tiles,
+             ok ? "" : "  FAIL");
+      fflush(stdout);
+    }
+  }
+
+  if (failures > 0) {
+    printf("%d checks failed.\n", failures);
+    return 1;
+  }
+  printf("All checks passed.\n");
+  return 0;
+}
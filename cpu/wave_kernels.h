@@ -0,0 +1,127 @@
+// Kernels that evaluate the sum of waves in a WaveTable over a block of
+// pixels.  They all compute the same field, but trade setup cost against
+// per pixel cost differently:
+//   SumWavesDirect      one cos per pixel per wave.
+//   SumWavesSimd        the direct kernel with a polynomial cos, so that
+//                       the pixel loop runs in SIMD lanes.
+//   SumWavesRecurrence  steps each wave along a row by a complex rotation,
+//                       so cos and sin are only needed once per wave per
+//                       block of kRecurrenceBlock pixels.  A handful of
+//                       multiply-adds per pixel per wave.
+//   SumWavesNufft       treats the block as a nonuniform FFT of the wave
+//                       amplitudes, so the cost per pixel does not grow with
+//                       the number of waves.  Worth it beyond roughly
+//                       kNufftCrossover waves.
+//   SumWavesSeparable   factors each wave into exp(i kx u) along rows and
+//                       exp(i ky v) down columns, so a pixel costs two
+//                       multiply-adds per wave once (width + height) trig
+//                       values per wave are tabulated.  SeparableTables
+//                       keeps the tables to evaluate many times cheaply.
+//
+// Each kernel writes the sum at pixel (x0 + i, y0 + j) to
+// out[j * stride + i] for the width x height block of pixels at (x0, y0).
+// Kernels are reentrant and can be called concurrently on disjoint blocks.
+
+#ifndef QUASICRYSTAL_WAVE_KERNELS_H
+#define QUASICRYSTAL_WAVE_KERNELS_H
+
+#include <string>
+#include <vector>
+
+#include "wave_table.h"
+
+namespace quasicrystal {
+
+// Number of pixels in a row advanced by recurrence between exact
+// evaluations of cos and sin.
+const int kRecurrenceBlock = 512;
+
+// Side of the square tiles the NUFFT kernel evaluates at once.  Blocks that
+// are multiples of this in both directions waste no work.
+const int kNufftTile = 128;
+
+// Number of waves beyond which the NUFFT kernel beats the recurrence, as
+// measured by crossover_benchmark.
+const int kNufftCrossover = 96;
+
+enum Kernel {
+  kDirectKernel,
+  kSimdKernel,
+  kRecurrenceKernel,
+  kNufftKernel,
+  kSeparableKernel,
+};
+
+void SumWavesDirect(const WaveTable& waves, float t,
+                    int x0, int y0, int width, int height,
+                    float* out, int stride);
+
+void SumWavesSimd(const WaveTable& waves, float t,
+                  int x0, int y0, int width, int height,
+                  float* out, int stride);
+
+void SumWavesRecurrence(const WaveTable& waves, float t,
+                        int x0, int y0, int width, int height,
+                        float* out, int stride);
+
+void SumWavesNufft(const WaveTable& waves, float t,
+                   int x0, int y0, int width, int height,
+                   float* out, int stride);
+
+void SumWavesSeparable(const WaveTable& waves, float t,
+                       int x0, int y0, int width, int height,
+                       float* out, int stride);
+
+// Trig tables for evaluating one WaveTable over a fixed block of pixels at
+// any number of times, as parameter sweeps do.  Only the temporal phases are
+// recomputed for each time.  The tables only depend on the wave vectors and
+// center, so they also serve waves that differ in anything else.
+class SeparableTables {
+ public:
+  SeparableTables(const WaveTable& waves, int x0, int y0,
+                  int width, int height);
+
+  // Write the sum at time t for rows [row_begin, row_end) of the block,
+  // with row row_begin at out.  Thread-safe.
+  void Sum(float t, int row_begin, int row_end, float* out, int stride) const;
+  // As above, for waves with the same kx, ky and center as the tables' but
+  // their own phases, angular frequencies, amplitudes and bias.
+  void Sum(const WaveTable& waves, float t, int row_begin, int row_end,
+           float* out, int stride) const;
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+ private:
+  WaveTable waves_;
+  int width_, height_;
+  // cos and sin of kx * u for wave w at column i, at [w * width + i].
+  std::vector<float> row_cos_, row_sin_;
+  // cos and sin of ky * v for wave w at row j, at [w * height + j].
+  std::vector<float> column_cos_, column_sin_;
+};
+
+// Evaluate the waves at n scattered points (x[i], y[i]) in pixel
+// coordinates at times t[i], with the simd kernel's polynomial cos.  Writes
+// the sums to sum, and if grad_x and grad_y are not null, their analytic
+// derivatives with respect to x and y.
+void SumWavesAtPoints(const WaveTable& waves, const float* x, const float* y,
+                      const float* t, int n, float* sum, float* grad_x,
+                      float* grad_y);
+
+// Dispatch to one of the kernels above.
+void SumWaves(Kernel kernel, const WaveTable& waves, float t,
+              int x0, int y0, int width, int height,
+              float* out, int stride);
+
+// Convert between kernels and their names, "direct", "simd", "recurrence",
+// "nufft" and "separable".  ParseKernel returns false for an unknown name.
+const char* KernelName(Kernel kernel);
+bool ParseKernel(const std::string& name, Kernel* kernel);
+
+// The kernel expected to be fastest for the given number of waves.
+Kernel ChooseKernel(int num_waves);
+
+}  // namespace quasicrystal
+
+#endif
@@ -0,0 +1,55 @@
+#include "wave_table.h"
+
+#include <cmath>
+
+#include "common/qc_params.h"
+
+namespace quasicrystal {
+
+void WaveTable::Add(float kx, float ky, float phase, float omega,
+                    float amplitude) {
+  this->kx.push_back(kx);
+  this->ky.push_back(ky);
+  this->phase.push_back(phase);
+  this->omega.push_back(omega);
+  this->amplitude.push_back(amplitude);
+}
+
+WaveTable MakeCrystalWaves(int num_waves, float freq) {
+  WaveTable waves;
+  for (int i = 0; i < num_waves; ++i) {
+    float angle = i * M_PI / num_waves;
+    waves.Add(freq * std::cos(angle), freq * std::sin(angle),
+              0.0f, 0.05f * (i + 1), 0.5f);
+    waves.bias += 0.5f;
+  }
+  return waves;
+}
+
+void ApplyPixelFilter(WaveTable* waves) {
+  for (int i = 0; i < waves->size(); ++i) {
+    waves->amplitude[i] *=
+        Sinc(0.5f * waves->kx[i]) * Sinc(0.5f * waves->ky[i]);
+  }
+}
+
+void ApplyMotionBlur(float shutter, WaveTable* waves) {
+  for (int i = 0; i < waves->size(); ++i) {
+    const float lag = 0.5f * waves->omega[i] * shutter;
+    waves->amplitude[i] *= Sinc(lag);
+    waves->phase[i] -= lag;
+  }
+}
+
+void ScaleWaves(float pixel_size, WaveTable* waves) {
+  for (int i = 0; i < waves->size(); ++i) {
+    waves->kx[i] *= pixel_size;
+    waves->ky[i] *= pixel_size;
+  }
+  // Pixel centers stay at integer coordinates, so the center moves by half
+  // a pixel less than a pure scaling would.
+  waves->center_x = (waves->center_x + 0.5f) / pixel_size - 0.5f;
+  waves->center_y = (waves->center_y + 0.5f) / pixel_size - 0.5f;
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,63 @@
+// A sum of plane waves, stored as a structure of arrays so that kernels can
+// stream through one parameter at a time.  Wave i contributes
+//   amplitude[i] * cos(kx[i] * u + ky[i] * v + phase[i] + omega[i] * t)
+// at field coordinates (u, v) = (x - center_x, y - center_y), where (x, y)
+// are pixel coordinates.  The constant bias is added on top of the sum.
+
+#ifndef QUASICRYSTAL_WAVE_TABLE_H
+#define QUASICRYSTAL_WAVE_TABLE_H
+
+#include <vector>
+
+namespace quasicrystal {
+
+struct WaveTable {
+  WaveTable() : bias(0.0f), center_x(0.0f), center_y(0.0f) {}
+
+  // Append a wave to the table.
+  void Add(float kx, float ky, float phase, float omega, float amplitude);
+
+  int size() const { return static_cast<int>(kx.size()); }
+
+  // Spatial frequency of each wave, in radians per pixel.
+  std::vector<float> kx, ky;
+  // Phase of each wave at t = 0 and the field origin.
+  std::vector<float> phase;
+  // Angular frequency of each wave, in radians per unit of t.
+  std::vector<float> omega;
+  // Amplitude of each wave.
+  std::vector<float> amplitude;
+  // Constant added to the sum of waves.
+  float bias;
+  // Location of the field origin in pixel coordinates.
+  float center_x, center_y;
+};
+
+// The waves of the original cpu quasicrystal: num_waves waves with
+// wavenumber freq at angles i * pi / num_waves, where wave i moves with
+// angular frequency 0.05 * (i + 1) per step, each contributing
+// 0.5 * (cos(...) + 1).
+WaveTable MakeCrystalWaves(int num_waves, float freq);
+
+// Replace each wave by its average over a unit pixel box centered on the
+// sample, which for a plane wave is an attenuation of its amplitude by
+// sinc(kx / 2) * sinc(ky / 2).
+void ApplyPixelFilter(WaveTable* waves);
+
+// Replace each wave by its average over the time from t - shutter to t, so
+// that a frame at t shows the motion over the shutter interval before it.
+// shutter is negative for time running backwards.
+// A wave's phase moves linearly in time, so this is an attenuation of its
+// amplitude by sinc(omega * shutter / 2) and a lag of its phase by
+// omega * shutter / 2.  Like the pixel filter, it applies before the
+// nonlinearity of coloring, so it approximates averaging the frames.
+void ApplyMotionBlur(float shutter, WaveTable* waves);
+
+// Resample waves onto pixels pixel_size times as large, so that a frame of
+// width / pixel_size x height / pixel_size pixels shows what a width x height
+// frame would, as thumbnails do.
+void ScaleWaves(float pixel_size, WaveTable* waves);
+
+}  // namespace quasicrystal
+
+#endif
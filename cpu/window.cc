@@ -1,9 +1,14 @@
 #include "window.h"
 
+#include <unistd.h>
+
 #include <iostream>
 
 #include <GL/gl.h>
 #include <GL/glx.h>
+#include <X11/Xutil.h>
+
+#include "common/trace.h"
 
 namespace util {
 
@@ -146,45 +151,58 @@ void Window::ResizeGLScene() {
   glLoadIdentity();
 }
 
+void Window::HandleEvents() {
+  TRACE_SPAN("HandleEvents");
+  while (XPending(gl_win_->dpy) > 0) {
+    XEvent event;
+    XNextEvent(gl_win_->dpy, &event);
+    switch (event.type) {
+      case ConfigureNotify:
+        if ((static_cast<unsigned int>(event.xconfigure.width) !=
+             gl_win_->width) ||
+            (static_cast<unsigned int>(event.xconfigure.height) !=
+             gl_win_->height)) {
+          gl_win_->width = event.xconfigure.width;
+          gl_win_->height = event.xconfigure.height;
+          ResizeGLScene();
+        }
+        break;
+      case ClientMessage:
+        if (*XGetAtomName(gl_win_->dpy, event.xclient.message_type) ==
+            *"WM_PROTOCOLS") {
+          HandleClose();
+        }
+        break;
+      case KeyPress: {
+        KeySym keysym;
+        XLookupString(&event.xkey, nullptr, 0, &keysym, nullptr);
+        HandleKey(event.xkey.state, keysym);
+        break;
+      }
+    }
+  }
+}
+
 void Window::RunUIThread() {
   // Attach the GLX context to our window.  This must be done in the thread
   // where we'll be doing our rendering.
   glXMakeCurrent(gl_win_->dpy, gl_win_->win, gl_win_->ctx);
+  quasicrystal::trace::SetThreadName("ui");
 
   ResizeGLScene();
 
   running_ = true;
   while (running_) {
-    // Handle any pending events.
-    while (XPending(gl_win_->dpy) > 0) {
-      XEvent event;
-      XNextEvent(gl_win_->dpy, &event);
-      switch (event.type) {
-        case ConfigureNotify:
-          if ((static_cast<unsigned int>(event.xconfigure.width) !=
-               gl_win_->width) ||
-              (static_cast<unsigned int>(event.xconfigure.height) !=
-               gl_win_->height)) {
-            gl_win_->width = event.xconfigure.width;
-            gl_win_->height = event.xconfigure.height;
-            ResizeGLScene();
-          }
-          break;
-        case ClientMessage:
-          if (*XGetAtomName(gl_win_->dpy, event.xclient.message_type) ==
-              *"WM_PROTOCOLS") {
-            HandleClose();
-          }
-          break;
-        case KeyPress:
-          HandleKey(event.xkey.state, event.xkey.keycode);
-          break;
-      }
-    }
+    HandleEvents();
 
-    HandleDraw();
-    
-    glXSwapBuffers(gl_win_->dpy, gl_win_->win);
+    {
+      TRACE_SPAN("HandleDraw");
+      HandleDraw();
+    }
+    {
+      TRACE_SPAN("glXSwapBuffers");
+      glXSwapBuffers(gl_win_->dpy, gl_win_->win);
+    }
     
     // Sleep for a while so as not to spin the proc.
     usleep(100000);
@@ -20,8 +20,8 @@ class Window {
   virtual ~Window();
   
  protected:
-  // Methods to be overloaded by subclasses.
-  virtual void HandleKey(unsigned int state, unsigned int keycode) = 0;
+  // Methods to be overloaded by subclasses.  The key is an X11 KeySym.
+  virtual void HandleKey(unsigned int state, unsigned int key) = 0;
   virtual void HandleDraw() = 0;
   virtual void HandleClose() = 0;
   
@@ -38,6 +38,9 @@ class Window {
   // Resize the OpenGL scene to fit the window size.
   void ResizeGLScene();
 
+  // Handle any pending X events.
+  void HandleEvents();
+
   // Callback for running the X UI thread.
   // TODO(piotrf): this should probably be in some singleton
   // shared among all windows.
@@ -0,0 +1,79 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace quasicrystal {
+
+struct WorkerPool::Job {
+  const std::function<void(int)>* task;
+  int num_tasks;
+  // Next task to hand out, and number of tasks that have finished.
+  int next_task;
+  int num_finished;
+  // Signalled when num_finished reaches num_tasks.
+  std::condition_variable finished;
+};
+
+WorkerPool::WorkerPool(int num_threads) : stopping_(false) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&WorkerPool::WorkerLoop, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkerPool::Run(int num_tasks, const std::function<void(int)>& task) {
+  if (num_tasks <= 0) {
+    return;
+  }
+  Job job;
+  job.task = &task;
+  job.num_tasks = num_tasks;
+  job.next_task = 0;
+  job.num_finished = 0;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobs_.push_back(&job);
+  work_available_.notify_all();
+  job.finished.wait(lock, [&job] { return job.num_finished == job.num_tasks; });
+}
+
+void WorkerPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_available_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+    if (jobs_.empty()) {
+      return;
+    }
+    // Take one task from the job at the front, and move that job to the back
+    // so the next worker serves a different job.
+    Job* job = jobs_.front();
+    jobs_.pop_front();
+    const int index = job->next_task++;
+    if (job->next_task < job->num_tasks) {
+      jobs_.push_back(job);
+    }
+
+    lock.unlock();
+    (*job->task)(index);
+    lock.lock();
+
+    if (++job->num_finished == job->num_tasks) {
+      job->finished.notify_all();
+    }
+  }
+}
+
+}  // namespace quasicrystal
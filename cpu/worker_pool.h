@@ -0,0 +1,54 @@
+// A fixed set of worker threads shared by many concurrent jobs.  A job is a
+// number of independent tasks, and workers take tasks from the running jobs
+// in round robin order, so a large job submitted first cannot starve small
+// jobs submitted after it.
+//
+// Example:
+//   WorkerPool pool(8);
+//   // From any number of threads at once:
+//   pool.Run(num_bands, [&](int band) { RenderBand(band); });
+
+#ifndef QUASICRYSTAL_WORKER_POOL_H
+#define QUASICRYSTAL_WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace quasicrystal {
+
+class WorkerPool {
+ public:
+  // Start num_threads workers, or one per hardware thread if num_threads is
+  // not positive.
+  explicit WorkerPool(int num_threads = 0);
+  ~WorkerPool();
+
+  // Run task(i) for i in [0, num_tasks) on the workers, and block until all
+  // of them have finished.  Thread-safe, but must not be called from inside
+  // a task.
+  void Run(int num_tasks, const std::function<void(int)>& task);
+
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  struct Job;
+
+  // Main loop of each worker thread.
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  // Signalled when a job is added or the pool is shutting down.
+  std::condition_variable work_available_;
+  // Jobs that still have tasks to hand out, served round robin.
+  std::deque<Job*> jobs_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace quasicrystal
+
+#endif
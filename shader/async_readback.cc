@@ -0,0 +1,82 @@
+#include "async_readback.h"
+
+#include "common/trace.h"
+
+namespace quasicrystal {
+
+AsyncReadback::AsyncReadback(int width, int height, int num_buffers,
+                             const Callback& done)
+    : width_(width),
+      height_(height),
+      done_(done),
+      buffers_(num_buffers),
+      next_(0) {
+  for (Buffer& buffer : buffers_) {
+    glGenBuffers(1, &buffer.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER, 4 * width * height, nullptr,
+                 GL_STREAM_READ);
+    buffer.fence = nullptr;
+    buffer.frame = -1;
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+AsyncReadback::~AsyncReadback() {
+  for (Buffer& buffer : buffers_) {
+    if (buffer.fence != nullptr) {
+      glDeleteSync(buffer.fence);
+    }
+    glDeleteBuffers(1, &buffer.pbo);
+  }
+}
+
+bool AsyncReadback::Supported() {
+  return GLEW_ARB_pixel_buffer_object && GLEW_ARB_sync;
+}
+
+void AsyncReadback::Read(long long frame) {
+  Buffer& buffer = buffers_[next_];
+  if (buffer.fence != nullptr) {
+    Finish(&buffer);
+  }
+  TRACE_SPAN("AsyncReadback::Read");
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer.pbo);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  // Into the buffer, so this returns without waiting for the frame.
+  glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  buffer.frame = frame;
+  next_ = (next_ + 1) % buffers_.size();
+}
+
+void AsyncReadback::Finish() {
+  // Oldest first, so frames come out in order.
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    Buffer& buffer = buffers_[(next_ + i) % buffers_.size()];
+    if (buffer.fence != nullptr) {
+      Finish(&buffer);
+    }
+  }
+}
+
+void AsyncReadback::Finish(Buffer* buffer) {
+  TRACE_SPAN("AsyncReadback::Finish");
+  // Flush so that the fence is sure to be signaled.
+  while (glClientWaitSync(buffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                          1000000000) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(buffer->fence);
+  buffer->fence = nullptr;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer->pbo);
+  const uint8_t* rgba = static_cast<const uint8_t*>(
+      glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+  if (rgba != nullptr) {
+    done_(buffer->frame, rgba);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,59 @@
+// Reads frames back from the gpu without waiting for them.  Each frame is
+// read into one of a ring of pixel buffer objects, which the driver fills
+// once the frame is drawn, while the next frames are drawn.  A frame is
+// only mapped, behind a fence, when its buffer is needed again, or at the
+// end.  Requires GL_ARB_pixel_buffer_object and GL_ARB_sync.
+
+#ifndef QUASICRYSTAL_ASYNC_READBACK_H
+#define QUASICRYSTAL_ASYNC_READBACK_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace quasicrystal {
+
+class AsyncReadback {
+ public:
+  // Called with each frame read back, as width x height RGBA pixels, with
+  // the bottom row first.
+  typedef std::function<void(long long frame, const uint8_t* rgba)> Callback;
+
+  // Read width x height frames with a ring of num_buffers buffers, passing
+  // each to done in order.
+  AsyncReadback(int width, int height, int num_buffers,
+                const Callback& done);
+  ~AsyncReadback();
+
+  // Whether this build of GL has what AsyncReadback needs.
+  static bool Supported();
+
+  // Start reading the bottom left of the current read framebuffer as the
+  // given frame.  If every buffer is busy, the oldest is finished first.
+  void Read(long long frame);
+
+  // Finish every frame still being read.
+  void Finish();
+
+ private:
+  struct Buffer {
+    GLuint pbo;
+    GLsync fence;
+    long long frame;
+  };
+
+  // Wait for buffer, pass its frame to done_ and free it.
+  void Finish(Buffer* buffer);
+
+  int width_, height_;
+  Callback done_;
+  std::vector<Buffer> buffers_;
+  // The buffer to use next, which is also the oldest in use.
+  size_t next_;
+};
+
+}  // namespace quasicrystal
+
+#endif
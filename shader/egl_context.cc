@@ -0,0 +1,101 @@
+#include "egl_context.h"
+
+#include <EGL/eglext.h>
+
+#include "extensions.h"
+
+namespace graphics {
+
+EglContext::EglContext()
+    : display_(EGL_NO_DISPLAY),
+      context_(EGL_NO_CONTEXT),
+      surface_(EGL_NO_SURFACE) {
+}
+
+EglContext::~EglContext() {
+  if (display_ == EGL_NO_DISPLAY) {
+    return;
+  }
+  eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (context_ != EGL_NO_CONTEXT) {
+    eglDestroyContext(display_, context_);
+  }
+  if (surface_ != EGL_NO_SURFACE) {
+    eglDestroySurface(display_, surface_);
+  }
+  eglTerminate(display_);
+}
+
+bool EglContext::Init(std::string* error) {
+  std::string unused;
+  if (error == nullptr) {
+    error = &unused;
+  }
+  // Client extensions, which say which platforms there are.
+  const char* client_extensions =
+      eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+          eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display != nullptr &&
+      HasExtension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+    display_ = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                    EGL_DEFAULT_DISPLAY, nullptr);
+  } else {
+    display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (display_ == EGL_NO_DISPLAY ||
+      !eglInitialize(display_, nullptr, nullptr)) {
+    *error = "no EGL display";
+    display_ = EGL_NO_DISPLAY;
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    *error = "EGL can not create desktop OpenGL contexts";
+    return false;
+  }
+
+  static const EGLint kConfigAttributes[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_NONE,
+  };
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display_, kConfigAttributes, &config, 1,
+                       &num_configs) || num_configs == 0) {
+    *error = "no suitable EGL config";
+    return false;
+  }
+  // The default is a compatibility context, which qc.frag and the fixed
+  // function drawing around it need.
+  context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, nullptr);
+  if (context_ == EGL_NO_CONTEXT) {
+    *error = "could not create an OpenGL context";
+    return false;
+  }
+
+  const char* extensions = eglQueryString(display_, EGL_EXTENSIONS);
+  if (!HasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+    static const EGLint kSurfaceAttributes[] = {
+      EGL_WIDTH, 1,
+      EGL_HEIGHT, 1,
+      EGL_NONE,
+    };
+    surface_ = eglCreatePbufferSurface(display_, config, kSurfaceAttributes);
+    if (surface_ == EGL_NO_SURFACE) {
+      *error = "could not create a pbuffer";
+      return false;
+    }
+  }
+  if (!eglMakeCurrent(display_, surface_, surface_, context_)) {
+    *error = "could not make the context current";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace graphics
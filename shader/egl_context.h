@@ -0,0 +1,33 @@
+// A GL context with no window, for rendering on machines without a display
+// or a GPU.  It uses EGL's surfaceless platform where the driver has it,
+// as Mesa's does, and otherwise the default display, and draws only into
+// framebuffer objects.
+
+#ifndef QUASICRYSTAL_EGL_CONTEXT_H
+#define QUASICRYSTAL_EGL_CONTEXT_H
+
+#include <string>
+
+#include <EGL/egl.h>
+
+namespace graphics {
+
+class EglContext {
+ public:
+  EglContext();
+  ~EglContext();
+
+  // Create the context and make it current on the calling thread.  Returns
+  // false, and if error is not null sets it to why, if that fails.
+  bool Init(std::string* error);
+
+ private:
+  EGLDisplay display_;
+  EGLContext context_;
+  // Only used if the context can not be made current without a surface.
+  EGLSurface surface_;
+};
+
+}  // namespace graphics
+
+#endif
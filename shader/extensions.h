@@ -0,0 +1,29 @@
+// Matching of the space separated extension lists that GLX and EGL report.
+
+#ifndef QUASICRYSTAL_EXTENSIONS_H
+#define QUASICRYSTAL_EXTENSIONS_H
+
+#include <cstring>
+
+namespace graphics {
+
+// Whether the space separated list of extensions includes name.  A null
+// list has none.
+inline bool HasExtension(const char* extensions, const char* name) {
+  if (extensions == nullptr) {
+    return false;
+  }
+  const size_t length = strlen(name);
+  for (const char* found = strstr(extensions, name); found != nullptr;
+       found = strstr(found + length, name)) {
+    if ((found == extensions || found[-1] == ' ') &&
+        (found[length] == ' ' || found[length] == '\0')) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace graphics
+
+#endif
@@ -0,0 +1,230 @@
+#include "frame_timer.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace quasicrystal {
+
+namespace {
+
+// Frames whose gpu times may be pending at once.  Results of a frame are
+// read back when its slot comes round again, by which time the gpu has
+// almost always finished it.
+const int kFramesInFlight = 3;
+
+// Colors of each part in the overlay.
+const float kPartColors[FrameTimer::kNumParts][3] = {
+  {0.2f, 0.4f, 1.0f},  // events
+  {0.0f, 0.8f, 0.8f},  // upload
+  {0.0f, 1.0f, 0.0f},  // shader
+  {1.0f, 1.0f, 0.0f},  // overlay
+  {1.0f, 0.5f, 0.0f},  // swap
+  {1.0f, 1.0f, 1.0f},  // frame
+};
+
+double NowMilliseconds() {
+  return std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+FrameTimer::Frame::Frame() : number(-1) {
+  std::fill(ms, ms + kNumParts, -1.0);
+  std::fill(queries, queries + kNumMarks, 0);
+}
+
+FrameTimer::FrameTimer(int window)
+    : window_(window),
+      gpu_timing_(GLEW_ARB_timer_query),
+      frames_(kFramesInFlight),
+      frame_number_(-1),
+      frame_start_ms_(0.0),
+      log_(nullptr) {
+  if (gpu_timing_) {
+    for (Frame& frame : frames_) {
+      glGenQueries(kNumMarks, frame.queries);
+    }
+  }
+  for (int part = 0; part < kNumParts; ++part) {
+    next_sample_[part] = 0;
+  }
+}
+
+FrameTimer::~FrameTimer() {
+  // Log the frames still in flight, oldest first.
+  for (long long number = std::max(0LL, frame_number_ - kFramesInFlight + 1);
+       number <= frame_number_; ++number) {
+    Finish(&frames_[number % kFramesInFlight], true);
+  }
+  if (gpu_timing_) {
+    for (Frame& frame : frames_) {
+      glDeleteQueries(kNumMarks, frame.queries);
+    }
+  }
+  if (log_ != nullptr) {
+    fclose(log_);
+  }
+}
+
+bool FrameTimer::OpenLog(const std::string& path) {
+  log_ = fopen(path.c_str(), "w");
+  if (log_ == nullptr) {
+    return false;
+  }
+  // Parts that were not measured are left empty.
+  fprintf(log_, "frame");
+  for (int part = 0; part < kNumParts; ++part) {
+    fprintf(log_, ",%s_ms", PartName(static_cast<Part>(part)));
+  }
+  fprintf(log_, "\n");
+  return true;
+}
+
+void FrameTimer::BeginFrame(double previous_swap_ms, double events_ms,
+                            double wait_ms) {
+  const double now = NowMilliseconds();
+  if (frame_number_ >= 0) {
+    Frame& previous = frames_[frame_number_ % kFramesInFlight];
+    previous.ms[kSwap] = previous_swap_ms;
+    previous.ms[kFrame] = now - frame_start_ms_ - wait_ms;
+  }
+  ++frame_number_;
+  frame_start_ms_ = now;
+  Frame& frame = frames_[frame_number_ % kFramesInFlight];
+  Finish(&frame, false);
+  frame.number = frame_number_;
+  std::fill(frame.ms, frame.ms + kNumParts, -1.0);
+  frame.ms[kEvents] = events_ms;
+}
+
+void FrameTimer::Record(Part part, double ms) {
+  frames_[frame_number_ % kFramesInFlight].ms[part] = ms;
+}
+
+void FrameTimer::Mark(GpuMark mark) {
+  if (gpu_timing_) {
+    glQueryCounter(frames_[frame_number_ % kFramesInFlight].queries[mark],
+                   GL_TIMESTAMP);
+  }
+}
+
+void FrameTimer::Finish(Frame* frame, bool wait) {
+  if (frame->number < 0) {
+    return;
+  }
+  if (gpu_timing_) {
+    GLint available = GL_TRUE;
+    for (int mark = 0; mark < kNumMarks && available && !wait; ++mark) {
+      glGetQueryObjectiv(frame->queries[mark], GL_QUERY_RESULT_AVAILABLE,
+                         &available);
+    }
+    // Unless asked to wait, a frame the gpu has not finished yet is left
+    // out rather than waited for.
+    if (available) {
+      GLuint64 timestamps[kNumMarks];
+      for (int mark = 0; mark < kNumMarks; ++mark) {
+        glGetQueryObjectui64v(frame->queries[mark], GL_QUERY_RESULT,
+                              &timestamps[mark]);
+      }
+      frame->ms[kShader] = 1e-6 * (timestamps[kShaderEnd] -
+                                   timestamps[kShaderStart]);
+      frame->ms[kOverlay] = 1e-6 * (timestamps[kOverlayEnd] -
+                                    timestamps[kShaderEnd]);
+    }
+  }
+  for (int part = 0; part < kNumParts; ++part) {
+    if (frame->ms[part] >= 0.0) {
+      AddSample(static_cast<Part>(part), frame->ms[part]);
+    }
+  }
+  if (log_ != nullptr) {
+    fprintf(log_, "%lld", frame->number);
+    for (int part = 0; part < kNumParts; ++part) {
+      if (frame->ms[part] >= 0.0) {
+        fprintf(log_, ",%.4f", frame->ms[part]);
+      } else {
+        fprintf(log_, ",");
+      }
+    }
+    fprintf(log_, "\n");
+  }
+}
+
+void FrameTimer::AddSample(Part part, double ms) {
+  std::vector<double>& samples = samples_[part];
+  if (static_cast<int>(samples.size()) < window_) {
+    samples.push_back(ms);
+  } else {
+    samples[next_sample_[part]] = ms;
+    next_sample_[part] = (next_sample_[part] + 1) % window_;
+  }
+}
+
+double FrameTimer::Percentile(Part part, double percentile) const {
+  std::vector<double> samples = samples_[part];
+  if (samples.empty()) {
+    return 0.0;
+  }
+  const size_t rank = std::min(
+      samples.size() - 1,
+      static_cast<size_t>(percentile / 100.0 * samples.size()));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+void FrameTimer::Draw(double budget_ms) const {
+  const float left = 0.05f, top = 0.95f, height = 0.025f;
+  // Bars reach past the budget by up to half of it, after which they are
+  // cut off.
+  const float scale = 0.6f / budget_ms;
+  const float right = left + 1.5f * budget_ms * scale;
+  glBegin(GL_QUADS);
+  // A dark backdrop, so the bars show over any part of the crystal.
+  glColor3f(0.0f, 0.0f, 0.0f);
+  glVertex2f(left - 0.01f, top + 0.01f);
+  glVertex2f(right + 0.01f, top + 0.01f);
+  glVertex2f(right + 0.01f, top - kNumParts * 1.5f * height);
+  glVertex2f(left - 0.01f, top - kNumParts * 1.5f * height);
+  for (int part = 0; part < kNumParts; ++part) {
+    const float* color = kPartColors[part];
+    const float y = top - part * 1.5f * height;
+    const float bars[2][2] = {
+      {static_cast<float>(Percentile(static_cast<Part>(part), 90)), 0.5f},
+      {static_cast<float>(Percentile(static_cast<Part>(part), 50)), 1.0f},
+    };
+    for (const auto& bar : bars) {
+      const float x = std::min(right, left + bar[0] * scale);
+      glColor3f(bar[1] * color[0], bar[1] * color[1], bar[1] * color[2]);
+      glVertex2f(left, y - height);
+      glVertex2f(x, y - height);
+      glVertex2f(x, y);
+      glVertex2f(left, y);
+    }
+    const float tick = std::min(
+        right,
+        left + static_cast<float>(Percentile(static_cast<Part>(part), 99)) *
+                   scale);
+    glColor3f(color[0], color[1], color[2]);
+    glVertex2f(tick - 0.002f, y - height);
+    glVertex2f(tick + 0.002f, y - height);
+    glVertex2f(tick + 0.002f, y);
+    glVertex2f(tick - 0.002f, y);
+  }
+  glEnd();
+  // The budget.
+  glColor3f(1.0f, 0.0f, 0.0f);
+  glBegin(GL_LINES);
+  glVertex2f(left + budget_ms * scale, top + 0.01f);
+  glVertex2f(left + budget_ms * scale, top - kNumParts * 1.5f * height);
+  glEnd();
+}
+
+const char* FrameTimer::PartName(Part part) {
+  static const char* const kNames[kNumParts] = {
+    "events", "upload", "shader", "overlay", "swap", "frame",
+  };
+  return kNames[part];
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,115 @@
+// Times the parts of every frame of the shader viewer: handling events,
+// uploading uniforms and swapping on the cpu, and the shader pass and the
+// overlay on the gpu.  Gpu times come from GL_TIMESTAMP queries, read back
+// a few frames later so that waiting for them never stalls the pipeline.
+//
+// Rolling percentiles of each part can be drawn as an overlay of bars, like
+// ArrayAdjuster without any text, and every frame can be logged to a CSV
+// file.
+//
+// Example, once per frame:
+//   timer.BeginFrame(last_swap_ms, events_ms, wait_ms);
+//   timer.Mark(FrameTimer::kShaderStart);
+//   ...
+//   timer.Record(FrameTimer::kUpload, upload_ms);
+
+#ifndef QUASICRYSTAL_FRAME_TIMER_H
+#define QUASICRYSTAL_FRAME_TIMER_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace quasicrystal {
+
+class FrameTimer {
+ public:
+  // Parts of a frame, in the order they are drawn in the overlay.
+  enum Part {
+    kEvents,
+    kUpload,
+    kShader,
+    kOverlay,
+    kSwap,
+    // From the start of one frame to the start of the next.
+    kFrame,
+    kNumParts,
+  };
+
+  // Points of a frame on the gpu's timeline, between which the gpu parts
+  // are measured.
+  enum GpuMark {
+    kShaderStart,
+    kShaderEnd,
+    kOverlayEnd,
+    kNumMarks,
+  };
+
+  // Keep percentiles over the last window frames.  Must be created with a
+  // current context.
+  explicit FrameTimer(int window);
+  ~FrameTimer();
+
+  // Log every frame to path as CSV.  Returns false if it can not be
+  // written.
+  bool OpenLog(const std::string& path);
+
+  // Whether gpu parts are measured, which needs GL_ARB_timer_query.
+  bool gpu_timing() const { return gpu_timing_; }
+
+  // Start a new frame, given the times of the swap that ended the frame
+  // before, of handling this frame's events, and of waiting for events or
+  // the frame rate limit since the frame before, which is left out of the
+  // frame before's time.
+  void BeginFrame(double previous_swap_ms, double events_ms, double wait_ms);
+
+  // Record the time a cpu part of the current frame took.
+  void Record(Part part, double ms);
+
+  // Note that the gpu has reached mark in the current frame.
+  void Mark(GpuMark mark);
+
+  // The given percentile, 0 to 100, of part over the window, or 0 with
+  // nothing measured.
+  double Percentile(Part part, double percentile) const;
+
+  // Draw the percentiles of every part as bars, in the unit square: the
+  // median as a solid bar, the 90th percentile as a lighter one behind it
+  // and the 99th as a tick.  Bars are scaled so that budget_ms is the
+  // width of the square, with a mark at budget_ms itself.
+  void Draw(double budget_ms) const;
+
+  static const char* PartName(Part part);
+
+ private:
+  // What is known about a frame whose gpu times are still pending.
+  struct Frame {
+    Frame();
+    long long number;
+    double ms[kNumParts];
+    GLuint queries[kNumMarks];
+  };
+
+  // Collect the gpu times of frame, if they are ready or wait is true, and
+  // log it.
+  void Finish(Frame* frame, bool wait);
+
+  void AddSample(Part part, double ms);
+
+  int window_;
+  bool gpu_timing_;
+  // Frames in flight, written in turn.
+  std::vector<Frame> frames_;
+  long long frame_number_;
+  double frame_start_ms_;
+  // The last window_ samples of each part, written in turn.
+  std::vector<double> samples_[kNumParts];
+  int next_sample_[kNumParts];
+  FILE* log_;
+};
+
+}  // namespace quasicrystal
+
+#endif
@@ -0,0 +1,337 @@
+// Quasicrystals, shader version, rendered without a window, for machines
+// with no display or GPU.  Frames of qc.frag are drawn through a
+// surfaceless EGL context into a framebuffer object, read back without
+// stalling, and written out as PPM images, then the frame rate is reported
+// so that it can be compared with the cpu engine.
+//
+// The frames follow a session recorded by the viewer with --record, a
+// keyframed timeline (see common/timeline.h), or else the parameters from
+// the command line with a fixed time step.
+// Images go to files named by --output, a printf pattern of the frame
+// number, or with --output=- to stdout as one stream, for example:
+//   quasicrystal_headless --frames=300 --output=- |
+//       ffmpeg -f image2pipe -c:v ppm -i - quasicrystal.mp4
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+#include <GL/glew.h>
+
+#include "async_readback.h"
+#include "common/qc_params.h"
+#include "common/session.h"
+#include "common/timeline.h"
+#include "common/trace.h"
+#include "egl_context.h"
+#include "program_builder.h"
+#include "program_cache.h"
+#include "qc_shader_params.h"
+#include "render_target.h"
+#include "shader_util.h"
+#include "shader_variants.h"
+
+DEFINE_int32(width, 600, "Width of output image.");
+DEFINE_int32(height, 600, "Height of output image.");
+DEFINE_string(shader_source, "qc.frag",
+              "Path to fragment shader source code");
+DEFINE_int32(num_waves, 7, "Number of waves, max of 15.");
+DEFINE_string(wavenumbers,
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2,"
+              "0.2, 0.2, 0.2, 0.2, 0.2",
+              "Comma seperated list of per wave wavenumbers.");
+DEFINE_string(angular_frequencies,
+              "1.0, 0.9, 0.8, 0.7, 0.6,"
+              "0.5, 0.4, 0.3, 0.2, 0.1,"
+              "0.1, 0.2, 0.3, 0.4, 0.5",
+              "Comma seperated list of wave angular frequencies.");
+DEFINE_double(mix, 0.0, "Mixing parameter, from 0 to 1.");
+DEFINE_bool(antialias, false,
+            "Prefilter each wave over the pixel footprint before the "
+            "nonlinearity, instead of point sampling it.");
+DEFINE_double(shutter_angle, 0.0,
+              "If positive, blur the motion over this fraction of the time "
+              "between frames, in degrees out of 360, by averaging each wave "
+              "over it.  Sessions record their own shutter.");
+DEFINE_int32(frames, 100, "Number of frames to render.");
+DEFINE_double(dt, 0.05, "Time step per frame.");
+DEFINE_string(session, "",
+              "If set, render the frames of this session recorded by the "
+              "viewer, at its size and with its view and shutter, instead "
+              "of those described by the flags above.");
+DEFINE_string(timeline, "",
+              "If set, render the frames of this timeline, starting from the "
+              "parameters described by the flags above, and at its size if "
+              "it gives one.");
+DEFINE_string(output, "",
+              "If set, write frame n to the file named by this printf "
+              "pattern of n, such as frame%05d.ppm, or all frames to stdout "
+              "if it is -.");
+DEFINE_int32(readback_buffers, 3,
+             "Frames that may be in flight between drawing and writing.");
+DEFINE_bool(shader_cache, true,
+            "Keep built shader programs in ~/.quasicrystal_shaders, so that "
+            "later runs with the same driver can load them instead.");
+DEFINE_bool(shader_variants, true,
+            "Draw with programs specialized to the number of waves, built "
+            "as they are needed, instead of always the generic one.");
+DEFINE_string(trace, "",
+              "If set, record when each part of every frame runs, and write "
+              "it to this file on exit as Chrome trace event JSON.");
+
+using graphics::ShaderUtil;
+
+namespace quasicrystal {
+
+namespace {
+
+// Write width x height RGBA pixels, bottom row first, to file as a PPM.
+bool WritePpm(FILE* file, const uint8_t* rgba, int width, int height) {
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  std::vector<uint8_t> row(3 * width);
+  for (int y = height - 1; y >= 0; --y) {
+    const uint8_t* in = rgba + 4 * width * y;
+    for (int x = 0; x < width; ++x) {
+      row[3 * x + 0] = in[4 * x + 0];
+      row[3 * x + 1] = in[4 * x + 1];
+      row[3 * x + 2] = in[4 * x + 2];
+    }
+    fwrite(row.data(), 1, row.size(), file);
+  }
+  return !ferror(file);
+}
+
+// Write a frame as --output asks.
+bool WriteFrame(long long frame, const uint8_t* rgba, int width,
+                int height) {
+  TRACE_SPAN("WriteFrame");
+  if (FLAGS_output.empty()) {
+    return true;
+  }
+  if (FLAGS_output == "-") {
+    return WritePpm(stdout, rgba, width, height);
+  }
+  char path[4096];
+  snprintf(path, sizeof(path), FLAGS_output.c_str(),
+           static_cast<int>(frame));
+  FILE* file = fopen(path, "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool written = WritePpm(file, rgba, width, height);
+  return fclose(file) == 0 && written;
+}
+
+// Open the shutter of each frame for --shutter_angle of the time since the
+// frame before, or for the first, until the next.
+void SetShutters(std::vector<SessionFrame>* frames) {
+  if (FLAGS_shutter_angle <= 0.0 || frames->size() < 2) {
+    return;
+  }
+  for (size_t i = 0; i < frames->size(); ++i) {
+    const size_t previous = std::max<size_t>(i, 1) - 1;
+    (*frames)[i].shutter = FLAGS_shutter_angle / 360.0 *
+                           ((*frames)[previous + 1].params.t -
+                            (*frames)[previous].params.t);
+  }
+}
+
+// The frames to render, from --session, --timeline or the other flags.
+bool LoadFrames(int* width, int* height, std::vector<SessionFrame>* frames) {
+  if (!FLAGS_session.empty()) {
+    return ReadSession(FLAGS_session, width, height, frames) &&
+           !frames->empty();
+  }
+  *width = FLAGS_width;
+  *height = FLAGS_height;
+  SessionFrame frame;
+  frame.params = ParseQCParams(
+      FLAGS_num_waves, FLAGS_angular_frequencies, FLAGS_wavenumbers);
+  frame.params.mix = FLAGS_mix;
+  frame.antialias = FLAGS_antialias;
+  if (!FLAGS_timeline.empty()) {
+    Timeline timeline;
+    if (!ReadTimeline(FLAGS_timeline, frame.params, &timeline)) {
+      return false;
+    }
+    if (timeline.width > 0) {
+      *width = timeline.width;
+      *height = timeline.height;
+    }
+    const int num_frames = NumTimelineFrames(timeline);
+    for (int i = 0; i < num_frames; ++i) {
+      frame.params = EvaluateTimeline(timeline, i / timeline.fps);
+      frames->push_back(frame);
+    }
+  } else {
+    for (int i = 0; i < FLAGS_frames; ++i) {
+      // Like the viewer, which steps before drawing each frame.
+      frame.params.t = (i + 1) * FLAGS_dt;
+      frames->push_back(frame);
+    }
+  }
+  SetShutters(frames);
+  return true;
+}
+
+// Build the generic program from source, waiting for it.  Returns 0 if the
+// build failed.
+GLuint BuildGeneric(ProgramBuilder* builder, const std::string& source) {
+  bool built = false;
+  GLuint program = 0;
+  builder->Build(source, [&](GLuint result, const std::string& debug) {
+    built = true;
+    program = result;
+    if (result == 0) {
+      std::cerr << "ERROR: failed to build shader from "
+                << FLAGS_shader_source << std::endl << debug;
+    }
+  });
+  while (!built) {
+    builder->Poll();
+  }
+  return program;
+}
+
+int Run() {
+  graphics::EglContext context;
+  std::string error;
+  if (!context.Init(&error)) {
+    std::cerr << "ERROR: " << error << std::endl;
+    return 1;
+  }
+  const GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  // GLEW built for GLX also looks for an X display, which is of no matter.
+  if (glew_status != GLEW_OK && glew_status != GLEW_ERROR_NO_GLX_DISPLAY) {
+#else
+  if (glew_status != GLEW_OK) {
+#endif
+    std::cerr << "ERROR: failed to initialize GLEW" << std::endl;
+    return 1;
+  }
+  if (!glewIsSupported("GL_VERSION_2_0") || !RenderTarget::Supported() ||
+      !AsyncReadback::Supported()) {
+    std::cerr << "ERROR: OpenGL 2.0 with framebuffer objects, pixel "
+              << "buffer objects and sync objects is required" << std::endl;
+    return 1;
+  }
+  std::cerr << "Rendering with " << glGetString(GL_RENDERER) << std::endl;
+
+  int width, height;
+  std::vector<SessionFrame> frames;
+  if (!LoadFrames(&width, &height, &frames)) {
+    std::cerr << "Failed to read "
+              << (FLAGS_session.empty() ? FLAGS_timeline : FLAGS_session)
+              << std::endl;
+    return 1;
+  }
+  const std::string source = ShaderUtil::ReadSource(FLAGS_shader_source);
+  if (source.empty()) {
+    std::cerr << "ERROR: failed to load shader from " << FLAGS_shader_source
+              << std::endl;
+    return 1;
+  }
+
+  std::unique_ptr<ProgramCache> cache;
+  if (FLAGS_shader_cache && ProgramCache::Supported()) {
+    cache.reset(new ProgramCache(ProgramCache::DefaultDirectory()));
+  }
+  ProgramBuilder builder(nullptr, cache.get());
+  const GLuint generic = BuildGeneric(&builder, source);
+  if (generic == 0) {
+    return 1;
+  }
+  std::unique_ptr<ShaderVariants> variants;
+  if (FLAGS_shader_variants) {
+    variants.reset(new ShaderVariants(&builder, source, generic));
+  }
+
+  RenderTarget target;
+  if (!target.Resize(width, height)) {
+    std::cerr << "ERROR: failed to create a " << width << "x" << height
+              << " framebuffer" << std::endl;
+    return 1;
+  }
+  target.Bind(width, height);
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glOrtho(0, width, 0, height, -1.0, 1.0);
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+
+  QCParams params;
+  QCShaderParams shader_params(&params);
+  shader_params.set_resolution(width, height);
+  glUseProgram(generic);
+  shader_params.set_shader(generic);
+
+  bool written = true;
+  AsyncReadback readback(
+      width, height, std::max(1, FLAGS_readback_buffers),
+      [&](long long frame, const uint8_t* rgba) {
+        written = WriteFrame(frame, rgba, width, height) && written;
+      });
+
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    TRACE_SPAN("Frame");
+    params = frames[i].params;
+    shader_params.set_antialias(frames[i].antialias);
+    shader_params.set_view(frames[i].view_x, frames[i].view_y,
+                           frames[i].view_scale);
+    shader_params.set_shutter(frames[i].shutter);
+    builder.Poll();
+    if (variants != nullptr) {
+      const GLuint program = variants->Program(NumMixedWaves(params));
+      if (program != shader_params.shader()) {
+        glUseProgram(program);
+        shader_params.set_shader(program);
+      }
+    }
+    shader_params.UpdateShaderParams();
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBegin(GL_QUADS);
+    glVertex2i(0, 0);
+    glVertex2i(width, 0);
+    glVertex2i(width, height);
+    glVertex2i(0, height);
+    glEnd();
+    readback.Read(i);
+  }
+  readback.Finish();
+  const double seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  std::cerr << "Rendered " << frames.size() << " frames of " << width << "x"
+            << height << " in " << seconds << " s, "
+            << frames.size() / seconds << " frames/s" << std::endl;
+  if (!written) {
+    std::cerr << "Failed to write some frames to " << FLAGS_output
+              << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+}  // namespace
+
+}  // namespace quasicrystal
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  if (!FLAGS_trace.empty()) {
+    quasicrystal::trace::Start();
+    quasicrystal::trace::SetThreadName("main");
+  }
+  const int status = quasicrystal::Run();
+  if (!FLAGS_trace.empty() && !quasicrystal::trace::WriteJson(FLAGS_trace)) {
+    std::cerr << "Failed to write " << FLAGS_trace << std::endl;
+  }
+  return status;
+}
@@ -0,0 +1,147 @@
+#include "program_builder.h"
+
+#include "common/trace.h"
+#include "shader_util.h"
+
+using graphics::ShaderUtil;
+
+namespace quasicrystal {
+
+ProgramBuilder::ProgramBuilder(
+    std::unique_ptr<graphics::SharedContext> context,
+    const ProgramCache* cache)
+    : context_(std::move(context)),
+      cache_(cache),
+      stop_(false),
+      threaded_(context_ != nullptr) {
+  if (GLEW_ARB_parallel_shader_compile) {
+    // Let the driver use as many threads as it likes.
+    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  }
+  if (context_ != nullptr) {
+    thread_ = std::thread(&ProgramBuilder::Run, this);
+  }
+}
+
+ProgramBuilder::~ProgramBuilder() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+  }
+  // Programs nobody was told about.
+  for (const Job& job : building_) {
+    glDeleteProgram(job.program);
+  }
+  for (const Job& job : finished_) {
+    if (job.program != 0) {
+      glDeleteProgram(job.program);
+    }
+  }
+}
+
+void ProgramBuilder::Build(const std::string& source, const Callback& done) {
+  Job job;
+  job.source = source;
+  job.done = done;
+  job.program = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (threaded_) {
+      queued_.push_back(job);
+      wake_.notify_one();
+      return;
+    }
+  }
+  Start(job);
+}
+
+void ProgramBuilder::Start(Job job) {
+  TRACE_SPAN("ProgramBuilder::Build");
+  if (cache_ != nullptr && cache_->Load(job.source, &job.program)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_.push_back(job);
+  } else {
+    job.program =
+        ShaderUtil::StartBuildShader(job.source, GL_FRAGMENT_SHADER);
+    building_.push_back(job);
+  }
+}
+
+void ProgramBuilder::Poll() {
+  std::deque<Job> stranded;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!threaded_) {
+      stranded.swap(queued_);
+    }
+  }
+  for (const Job& job : stranded) {
+    Start(job);
+  }
+
+  std::vector<Job> finished;
+  for (size_t i = 0; i < building_.size();) {
+    if (ShaderUtil::IsBuildComplete(building_[i].program)) {
+      Finish(&building_[i]);
+      finished.push_back(building_[i]);
+      building_.erase(building_.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished.insert(finished.end(), finished_.begin(), finished_.end());
+    finished_.clear();
+  }
+  for (const Job& job : finished) {
+    job.done(job.program, job.debug);
+  }
+}
+
+void ProgramBuilder::Finish(Job* job) {
+  TRACE_SPAN("ProgramBuilder::Finish");
+  if (!ShaderUtil::FinishBuildShader(job->program, &job->debug)) {
+    job->program = 0;
+  } else if (cache_ != nullptr) {
+    cache_->Store(job->source, job->program);
+  }
+}
+
+void ProgramBuilder::Run() {
+  trace::SetThreadName("shader builder");
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!context_->MakeCurrent(true)) {
+    threaded_ = false;
+    return;
+  }
+  while (true) {
+    wake_.wait(lock, [this] { return stop_ || !queued_.empty(); });
+    if (stop_) {
+      break;
+    }
+    Job job = queued_.front();
+    queued_.pop_front();
+    lock.unlock();
+    {
+      TRACE_SPAN("ProgramBuilder::Build");
+      if (cache_ == nullptr || !cache_->Load(job.source, &job.program)) {
+        job.program =
+            ShaderUtil::StartBuildShader(job.source, GL_FRAGMENT_SHADER);
+        Finish(&job);
+      }
+      // The window's context may only use the program once it is complete.
+      glFinish();
+    }
+    lock.lock();
+    finished_.push_back(job);
+  }
+  lock.unlock();
+  context_->MakeCurrent(false);
+}
+
+}  // namespace quasicrystal
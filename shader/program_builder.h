@@ -0,0 +1,93 @@
+// Builds fragment shader programs without holding up the frames drawn
+// meanwhile.  Given a context that shares objects with the window's, the
+// builds run on a thread of their own; otherwise they run on the window's
+// thread, on the driver's compiler threads where it supports
+// GL_ARB_parallel_shader_compile.  Either way, programs found in the
+// program cache are loaded instead of built, and those built are stored.
+//
+// Example:
+//   ProgramBuilder builder(CreateSharedContext(), &cache);
+//   builder.Build(source, [this](GLuint program, const std::string& debug) {
+//     ...
+//   });
+//   // Once per frame:
+//   builder.Poll();
+
+#ifndef QUASICRYSTAL_PROGRAM_BUILDER_H
+#define QUASICRYSTAL_PROGRAM_BUILDER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "program_cache.h"
+#include "window.h"
+
+namespace quasicrystal {
+
+class ProgramBuilder {
+ public:
+  // Called with the built program, or with 0 and the error messages if the
+  // build failed.
+  typedef std::function<void(GLuint program, const std::string& debug)>
+      Callback;
+
+  // Build on context, if it is not null, and use cache, if it is not null.
+  // Must be created on the window's thread, with its context current.
+  ProgramBuilder(std::unique_ptr<graphics::SharedContext> context,
+                 const ProgramCache* cache);
+  ~ProgramBuilder();
+
+  // Start building a program from the source of a fragment shader.  done
+  // is called from Poll once it has been built.
+  void Build(const std::string& source, const Callback& done);
+
+  // Call back for every finished build.  Call once per frame.
+  void Poll();
+
+ private:
+  struct Job {
+    std::string source;
+    Callback done;
+    GLuint program;
+    std::string debug;
+  };
+
+  // Start building the program of job on the window's thread.
+  void Start(Job job);
+
+  // Finish building the program of job, and store it in the cache if it
+  // built.
+  void Finish(Job* job);
+
+  // The build thread.
+  void Run();
+
+  std::unique_ptr<graphics::SharedContext> context_;
+  const ProgramCache* cache_;
+
+  // Builds in progress on the window's thread, without a build thread.
+  std::vector<Job> building_;
+
+  // Guards the rest, which is shared with the build thread.
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+  // Whether jobs go to the build thread.  Cleared if it can not use its
+  // context, after which Poll starts any it left queued.
+  bool threaded_;
+  std::deque<Job> queued_;
+  std::vector<Job> finished_;
+  std::thread thread_;
+};
+
+}  // namespace quasicrystal
+
+#endif
@@ -0,0 +1,101 @@
+#include "program_cache.h"
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace quasicrystal {
+
+namespace {
+
+// 64 bit FNV-1a, which is plenty to tell sources apart.
+uint64_t Hash(const std::string& data) {
+  uint64_t hash = 14695981039346656037ull;
+  for (unsigned char c : data) {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+std::string GLString(GLenum name) {
+  const GLubyte* value = glGetString(name);
+  return value != nullptr ? reinterpret_cast<const char*>(value) : "";
+}
+
+}  // namespace
+
+ProgramCache::ProgramCache(const std::string& directory)
+    : directory_(directory),
+      driver_(GLString(GL_VENDOR) + "\n" + GLString(GL_RENDERER) + "\n" +
+              GLString(GL_VERSION)) {
+  // Fails harmlessly if it already exists; if it can not be made, Store
+  // reports it.
+  mkdir(directory_.c_str(), 0755);
+}
+
+std::string ProgramCache::DefaultDirectory() {
+  const char* home = getenv("HOME");
+  return home != nullptr ? std::string(home) + "/.quasicrystal_shaders" :
+                           ".quasicrystal_shaders";
+}
+
+bool ProgramCache::Supported() {
+  return GLEW_ARB_get_program_binary;
+}
+
+bool ProgramCache::Load(const std::string& source, GLuint* program) const {
+  std::ifstream file(Path(source), std::ios::binary);
+  GLenum format;
+  if (!file.read(reinterpret_cast<char*>(&format), sizeof(format))) {
+    return false;
+  }
+  const std::vector<char> binary((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+  *program = glCreateProgram();
+  glProgramBinary(*program, format, binary.data(),
+                  static_cast<GLsizei>(binary.size()));
+  GLint status;
+  glGetProgramiv(*program, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    glDeleteProgram(*program);
+    return false;
+  }
+  return true;
+}
+
+bool ProgramCache::Store(const std::string& source, GLuint program) const {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return false;
+  }
+  std::vector<char> binary(length);
+  GLenum format;
+  glGetProgramBinary(program, length, nullptr, &format, binary.data());
+  // Write a new file and move it into place, so that another run never
+  // reads half a program.
+  const std::string path = Path(source);
+  const std::string temporary_path = path + ".tmp";
+  FILE* file = fopen(temporary_path.c_str(), "wb");
+  if (file == nullptr) {
+    return false;
+  }
+  fwrite(&format, sizeof(format), 1, file);
+  fwrite(binary.data(), 1, binary.size(), file);
+  const bool written = fclose(file) == 0;
+  return written && rename(temporary_path.c_str(), path.c_str()) == 0;
+}
+
+std::string ProgramCache::Path(const std::string& source) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin",
+           static_cast<unsigned long long>(Hash(driver_ + "\n" + source)));
+  return directory_ + "/" + name;
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,50 @@
+// A persistent cache of linked programs, so that the shader is only
+// compiled the first time it is run on a machine.  Programs are stored with
+// glGetProgramBinary, one file per program, keyed by a hash of the source
+// and of the driver that built them; a different driver, or one that
+// rejects an old binary after an upgrade, means a rebuild.
+//
+// Requires GL_ARB_get_program_binary.  Not thread-safe; use it from the
+// one thread that builds programs.
+
+#ifndef QUASICRYSTAL_PROGRAM_CACHE_H
+#define QUASICRYSTAL_PROGRAM_CACHE_H
+
+#include <string>
+
+#include <GL/glew.h>
+
+namespace quasicrystal {
+
+class ProgramCache {
+ public:
+  // Cache programs in directory, which is created if need be.  Must be
+  // called with a current context, to identify the driver.
+  explicit ProgramCache(const std::string& directory);
+
+  // ~/.quasicrystal_shaders, or the working directory if HOME is not set.
+  static std::string DefaultDirectory();
+
+  // Whether this build of GL can save and restore programs.
+  static bool Supported();
+
+  // Create a program from the cached binary for source.  Returns false if
+  // there is none, or the driver rejected it.
+  bool Load(const std::string& source, GLuint* program) const;
+
+  // Save a linked program, built from source with
+  // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.  Returns false if it could not
+  // be written.
+  bool Store(const std::string& source, GLuint program) const;
+
+ private:
+  std::string Path(const std::string& source) const;
+
+  std::string directory_;
+  // Vendor, renderer and version strings of the driver.
+  std::string driver_;
+};
+
+}  // namespace quasicrystal
+
+#endif
@@ -4,72 +4,44 @@
 const float kPi = 3.14159;
 const int kMaxNumWaves = 15;
 
-// Parameters set outside of shader.
+// Programs specialized to one number of waves define WAVE_COUNT, see
+// ShaderVariants, and then only need a table that large.
+#ifdef WAVE_COUNT
+const int kTableSize = WAVE_COUNT;
+#else
+const int kTableSize = kMaxNumWaves;
+#endif
+
+// Parameters set outside of shader.  Everything that is the same for every
+// fragment is worked out on the cpu, see QCShaderParams.
 uniform float t;             // time
-uniform int num_waves;       // number of waves
-uniform float mix;           // mixing parameter for changing num_waves
-uniform sampler1D angular_frequencies;  // per wave angular frequencies
-uniform sampler1D wavenumbers;  // per wave wavenumbers
+uniform int wave_count;      // number of waves, unless specialized
+// Per wave table: wave vector x and y, angular frequency, and amplitude,
+// which includes the mixing weight and any antialiasing or motion blur
+// attenuation.
+uniform vec4 waves[kTableSize];
+uniform float bias;          // sum of the wave offsets
 
 uniform vec2 resolution;     // screen resolution
+uniform vec2 pixel_size;     // screen pixels per fragment
+// Point of the plane at the screen center, and plane units per screen pixel.
+uniform vec3 view;
 
 void main() {
-  float x = gl_FragCoord.x - 0.5 * resolution.x;
-  float y = gl_FragCoord.y - 0.5 * resolution.y;
-
-  // Weights for mixing in a new wave.
-  float weights[kMaxNumWaves];
-  for (int i = 0; i < kMaxNumWaves; ++i) {
-    weights[i] = 1.0;
-  }
-  weights[1] = mix;
-
-  // Initialize angles sines and coses.
-  float coses[kMaxNumWaves]; 
-  float sines[kMaxNumWaves];
-  coses[0] = 1.0;
-  sines[0] = 0.0;
-  for (int i = 1; i < num_waves + 1; ++i) {
-    float angle = (1.0 - mix) * float(i - 1) * kPi / float(num_waves) +
-        mix * float(i) * kPi / float(num_waves + 1);
-    coses[i] = cos(angle);
-    sines[i] = sin(angle);
-  }
-
-  // Mixing together angular frequencies.
-  float mixed_angular_freq[kMaxNumWaves];
-  vec4 phase_vec = texture1D(angular_frequencies,
-                             (float(0.0) + 0.5) / float(kMaxNumWaves));
-  mixed_angular_freq[0] = phase_vec.r;
-  for (int w = 1; w < num_waves + 1; ++w) {
-    vec4 phase_vec0 = texture1D(angular_frequencies,
-    	 	                (float(w - 1) + 0.5) / float(kMaxNumWaves));
-    vec4 phase_vec1 = texture1D(angular_frequencies, 
-    	 	                (float(w) + 0.5) / float(kMaxNumWaves));
-    mixed_angular_freq[w] = ((1.0 - mix) * phase_vec0.r + mix * phase_vec1.r);
-  }
-
-  // Mixing together wavenumbers.
-  float mixed_wavenumbers[kMaxNumWaves];
-  vec4 wn_vec = texture1D(wavenumbers,
-                          (float(0.0) + 0.5) / float(kMaxNumWaves));
-  mixed_wavenumbers[0] = wn_vec.r;
-  for (int w = 1; w < num_waves + 1; ++w) {
-    vec4 wn_vec0 = texture1D(wavenumbers,
-    	                     (float(w - 1) + 0.5) / float(kMaxNumWaves));
-    vec4 wn_vec1 = texture1D(wavenumbers, 
-    	                     (float(w) + 0.5) / float(kMaxNumWaves));
-    mixed_wavenumbers[w] = ((1.0 - mix) * wn_vec0.r + mix * wn_vec1.r);
-  }
+  float x = view.z * (pixel_size.x * gl_FragCoord.x - 0.5 * resolution.x) +
+            view.x;
+  float y = view.z * (pixel_size.y * gl_FragCoord.y - 0.5 * resolution.y) +
+            view.y;
 
   // Compute intensity over the sum of waves.
-  float p = 0.0;
-  for (int w = 0; w < num_waves + 1; ++w) {
-    float cx = coses[w] * x;
-    float sy = sines[w] * y;
-    p += weights[w] * 0.5 * (cos(mixed_wavenumbers[w] * (cx + sy) + 
-                                 mixed_angular_freq[w] * t)
-			      + 1.0);
+  float p = bias;
+#ifdef WAVE_COUNT
+  for (int w = 0; w < WAVE_COUNT; ++w) {
+#else
+  for (int w = 0; w < wave_count; ++w) {
+#endif
+    vec4 wave = waves[w];
+    p += wave.w * cos(wave.x * x + wave.y * y + wave.z * t);
   }
 
   // General Rotors patented color mixer:
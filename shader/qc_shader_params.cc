@@ -0,0 +1,83 @@
+#include "qc_shader_params.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/trace.h"
+
+namespace quasicrystal {
+
+QCShaderParams::QCShaderParams(const QCParams* params)
+    : params_(params),
+      shader_(0),
+      antialias_(false),
+      shutter_(0.0f),
+      width_(0),
+      height_(0),
+      pixel_width_(1.0f),
+      pixel_height_(1.0f),
+      view_x_(0.0f),
+      view_y_(0.0f),
+      view_scale_(1.0f),
+      dirty_(true) {
+}
+
+void QCShaderParams::UpdateShaderParams() {
+  TRACE_SPAN("UpdateShaderParams");
+  // Averaging a wave over the shutter interval before t also lags its phase
+  // by omega * shutter / 2, which is the same as moving every wave back by
+  // half the shutter.
+  glUniform1f(t_loc_, params_->t - 0.5f * shutter_);
+  if (!dirty_ && params_->num_waves == sent_.num_waves &&
+      params_->mix == sent_.mix &&
+      std::equal(params_->angular_frequencies,
+                 params_->angular_frequencies + kMaxNumWaves,
+                 sent_.angular_frequencies) &&
+      std::equal(params_->wavenumbers, params_->wavenumbers + kMaxNumWaves,
+                 sent_.wavenumbers)) {
+    return;
+  }
+  MixedWave mixed[kMaxNumWaves];
+  const int count = MixWaves(*params_, mixed);
+  GLfloat table[4 * kMaxNumWaves];
+  float bias = 0.0f;
+  for (int w = 0; w < count; ++w) {
+    // Averaging a plane wave over a w x h pixel box attenuates it by
+    // sinc(kx w / 2) * sinc(ky h / 2), so we can filter before the
+    // nonlinearity.
+    float attenuation = antialias_ ?
+        Sinc(0.5f * mixed[w].kx * view_scale_ * pixel_width_) *
+            Sinc(0.5f * mixed[w].ky * view_scale_ * pixel_height_) : 1.0f;
+    // Likewise averaging over the shutter interval attenuates it by
+    // sinc(omega shutter / 2), for motion blur.
+    attenuation *= Sinc(0.5f * mixed[w].angular_frequency * shutter_);
+    table[4 * w + 0] = mixed[w].kx;
+    table[4 * w + 1] = mixed[w].ky;
+    table[4 * w + 2] = mixed[w].angular_frequency;
+    table[4 * w + 3] = 0.5f * mixed[w].weight * attenuation;
+    bias += 0.5f * mixed[w].weight;
+  }
+  glUniform1i(wave_count_loc_, count);
+  glUniform4fv(waves_loc_, count, table);
+  glUniform1f(bias_loc_, bias);
+  glUniform2f(resolution_loc_, static_cast<float>(width_),
+              static_cast<float>(height_));
+  glUniform2f(pixel_size_loc_, pixel_width_, pixel_height_);
+  glUniform3f(view_loc_, view_x_, view_y_, view_scale_);
+  sent_ = *params_;
+  dirty_ = false;
+}
+
+void QCShaderParams::set_shader(GLuint shader) {
+  shader_ = shader;
+  t_loc_ = glGetUniformLocation(shader_, "t");
+  wave_count_loc_ = glGetUniformLocation(shader_, "wave_count");
+  waves_loc_ = glGetUniformLocation(shader_, "waves");
+  bias_loc_ = glGetUniformLocation(shader_, "bias");
+  resolution_loc_ = glGetUniformLocation(shader_, "resolution");
+  pixel_size_loc_ = glGetUniformLocation(shader_, "pixel_size");
+  view_loc_ = glGetUniformLocation(shader_, "view");
+  dirty_ = true;
+}
+
+}  // namespace quasicrystal
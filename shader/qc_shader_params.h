@@ -0,0 +1,85 @@
+// A class that bridges a set of quasicrystal parameters and a shader built
+// from qc.frag.  The table of waves, which is the same for every fragment,
+// is computed here and only sent to the shader when the parameters it
+// depends on change; in most frames only the time is sent.
+
+#ifndef QUASICRYSTAL_QC_SHADER_PARAMS_H
+#define QUASICRYSTAL_QC_SHADER_PARAMS_H
+
+#include <GL/glew.h>
+
+#include "common/qc_params.h"
+
+namespace quasicrystal {
+
+class QCShaderParams {
+ public:
+  QCShaderParams(const QCParams* params);
+
+  // Send our parameters down to the shader, which must be in use.
+  // Make sure the names match up with the variable names in the shader.
+  void UpdateShaderParams();
+  
+  // Switch to another program built from the same shader, sending it all
+  // of the parameters on the next update.
+  void set_shader(GLuint shader);
+  GLuint shader() const { return shader_; }
+
+  void set_resolution(int width, int height) {
+    width_ = width;
+    height_ = height;
+    dirty_ = true;
+  }
+
+  // The size of the fragments drawn, in screen pixels, which is more than 1
+  // when drawing at less than the screen's resolution.
+  void set_pixel_size(float width, float height) {
+    dirty_ |= width != pixel_width_ || height != pixel_height_;
+    pixel_width_ = width;
+    pixel_height_ = height;
+  }
+
+  // Show the plane around (x, y), with scale plane units per screen pixel,
+  // for panning and zooming.  The default is (0, 0) and 1.
+  void set_view(float x, float y, float scale) {
+    dirty_ |= x != view_x_ || y != view_y_ || scale != view_scale_;
+    view_x_ = x;
+    view_y_ = y;
+    view_scale_ = scale;
+  }
+
+  // Whether the shader should prefilter waves over the pixel footprint.
+  bool antialias() const { return antialias_; }
+  void set_antialias(bool antialias) {
+    dirty_ |= antialias != antialias_;
+    antialias_ = antialias;
+  }
+
+  // How much time before each frame the shader should prefilter waves over,
+  // for motion blur, or 0 for none.  Negative when time runs backwards.
+  float shutter() const { return shutter_; }
+  void set_shutter(float shutter) {
+    dirty_ |= shutter != shutter_;
+    shutter_ = shutter;
+  }
+  
+ private:
+  const QCParams* params_;
+  GLuint shader_;
+  bool antialias_;
+  float shutter_;
+  int width_, height_;
+  float pixel_width_, pixel_height_;
+  float view_x_, view_y_, view_scale_;
+  // Uniform locations in shader_.
+  GLint t_loc_, wave_count_loc_, waves_loc_, bias_loc_, resolution_loc_,
+      pixel_size_loc_, view_loc_;
+  // Whether the wave table must be sent regardless of sent_.
+  bool dirty_;
+  // The parameters the wave table in the shader was made from.
+  QCParams sent_;
+};
+
+}  // namespace quasicrystal
+
+#endif
@@ -11,7 +11,24 @@
 //   j, l        move wavenumber selector left or right
 //   i, k        increase / decrease selected wavenumber
 //   q           close angular frequency or wavenumber selector
-// 
+//   z           toggle antialiasing
+//   b           toggle motion blur
+//   arrow keys  pan
+//   page up and page down   zoom in or out
+//   home        go back to the initial view
+//   f           toggle the frame timing overlay
+//
+// While paused, frames are only drawn after a key press or other window
+// event, and otherwise the viewer sleeps.  Panning while paused moves the
+// last frame and only draws the strips it uncovers.
+//
+// With --record, every key press and the parameters of every frame are
+// written to a session file.  --replay plays a session back, pressing the
+// same keys before the same frames, and reports how long it took, so that a
+// slow sequence of edits can be reproduced and timed.  Both use a fixed
+// time step per frame, so a replay given the same flags as the recording
+// draws exactly the recorded frames, and warns if it does not.
+//
 // Idea based on code by Matthew Peddie:
 // https://github.com/peddie/quasicrystals/
 // which is in turn based on code from Keegan McAllister:
@@ -20,15 +37,30 @@
 // Used of GLSL and shaders based on the excellent tutorial on Lighthouse3D:
 // http://www.lighthouse3d.com/tutorials/glsl-tutorial/
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <vector>
+
+#include <sys/stat.h>
 
 #include <gflags/gflags.h>
 #include <GL/glew.h>
 
 #include "array_adjuster.h"
+#include "common/qc_params.h"
+#include "common/session.h"
+#include "common/trace.h"
+#include "frame_timer.h"
+#include "program_builder.h"
+#include "program_cache.h"
+#include "qc_shader_params.h"
+#include "render_target.h"
+#include "resolution_controller.h"
 #include "shader_util.h"
+#include "shader_variants.h"
 #include "window.h"
 
 DEFINE_int32(width, 600, "Width of output image.");
@@ -48,125 +80,92 @@ DEFINE_string(angular_frequencies,
               "Comma seperated list of initial wave angular frequencies.");
 DEFINE_double(time_granularity, 0.01,
               "Parameter that controls granularity in modifying the speed.");
-
-// Keep in sync with constant in qc.frag
-const int kMaxNumWaves = 15;
+DEFINE_bool(antialias, false,
+            "Prefilter each wave over the pixel footprint before the "
+            "nonlinearity, instead of point sampling it.");
+DEFINE_bool(motion_blur, false,
+            "Blur the motion over --shutter_angle of each time step, by "
+            "averaging each wave over it, at no extra cost per pixel.");
+DEFINE_double(shutter_angle, 180.0,
+              "Fraction of each time step that motion blur covers, in "
+              "degrees out of 360.");
+DEFINE_string(trace, "",
+              "If set, record when each part of every frame runs, and write "
+              "it to this file on exit as Chrome trace event JSON.");
+DEFINE_bool(shader_variants, true,
+            "Draw with programs specialized to the number of waves, built "
+            "as they are needed, instead of always the generic one.");
+DEFINE_bool(shader_cache, true,
+            "Keep built shader programs in ~/.quasicrystal_shaders, so that "
+            "later runs with the same driver can load them instead.");
+DEFINE_bool(background_compile, true,
+            "Build shader programs on a thread with a context of its own, "
+            "instead of between frames.");
+DEFINE_bool(reload_shader, true,
+            "Rebuild the shader whenever its source file changes, and "
+            "switch to it once it is built.");
+DEFINE_bool(dynamic_resolution, false,
+            "Draw at a lower resolution than the window's whenever that is "
+            "needed to keep up --target_fps, and scale the result up.");
+DEFINE_double(target_fps, 30.0,
+              "Frame rate that --dynamic_resolution aims for, and the budget "
+              "marked on the frame timing overlay.");
+DEFINE_double(min_resolution_scale, 0.25,
+              "Lowest fraction of the window's resolution, along each axis, "
+              "that --dynamic_resolution draws at.");
+DEFINE_bool(cache_frame, true,
+            "Keep the last frame drawn offscreen, and show it again instead "
+            "of rerunning the shader while nothing but the overlay changes, "
+            "such as when adjusting parameters while paused.");
+DEFINE_bool(frame_overlay, false,
+            "Start with the frame timing overlay shown.  It has a bar for "
+            "each of events, uniform upload, shader, overlay, swap and the "
+            "whole frame, top to bottom, showing the median and 90th and "
+            "99th percentiles of their times.");
+DEFINE_string(frame_csv, "",
+              "If set, log the times of the parts of every frame to this "
+              "file as CSV.");
+DEFINE_int32(swap_interval, 1,
+             "Vertical blanks to wait for before showing each frame, 0 to "
+             "not wait, or -1 to leave the driver's default.");
+DEFINE_double(max_fps, 0.0,
+              "If positive, draw at most this many frames per second.");
+DEFINE_string(record, "",
+              "If set, record the key presses and parameters of every frame "
+              "to this session file.");
+DEFINE_string(replay, "",
+              "If set, replay the session in this file at its recorded size "
+              "instead of taking input, then report the frame times.");
 
 using graphics::ShaderUtil;
 
 namespace quasicrystal {
 
-// A sufficient set of parameters to describe any snapshot of the quasicrystals.
-struct QCParams {
-  QCParams()
-      : t(0.0),
-        num_waves(1),
-        mix(0.0),
-        angular_frequencies({1.0}),
-        wavenumbers({0.2}) {}
-  // Current time in the wave propagation.
-  float t;
-  // Number of waves.
-  int num_waves;
-  // Wave number mixing parameter, 0 = num_waves, 1 = num_waves + 1
-  float mix;
-  // Angular frequencies of each wave, individually specified.
-  float angular_frequencies[kMaxNumWaves];
-  // Spatial frequency of each wave, individually specified.
-  float wavenumbers[kMaxNumWaves];
-};
-
-void SplitCommaSeparatedFloats(const std::string& str, float* v, int size) {
-  std::stringstream ss(str);
-  std::string temp;
-  int i = 0;
-  while (std::getline(ss, temp, ',') && i < size) {
-    v[i] = atof(temp.c_str());
-    ++i;
-  }
-}
-
 QCParams InitQCParamsFromFlags() {
-  QCParams params;
-  params.num_waves = std::max(std::min(FLAGS_num_waves, kMaxNumWaves), 1);
-  SplitCommaSeparatedFloats(
-      FLAGS_angular_frequencies, params.angular_frequencies, kMaxNumWaves);
-  SplitCommaSeparatedFloats(
-      FLAGS_wavenumbers, params.wavenumbers, kMaxNumWaves);
-  return params;
+  return ParseQCParams(
+      FLAGS_num_waves, FLAGS_angular_frequencies, FLAGS_wavenumbers);
 }
 
-// A class that bridges a set of quasicrystal parameters and a shader.
-class QCShaderParams {
- public:
-  QCShaderParams(const QCParams* params) : params_(params), shader_(0) {
-  }
-
-  // Initialize our connection to the shader with the given handle.
-  void Init(GLuint shader) {
-    shader_ = shader;
-    // The vector of angular frequencies is passed as a texture.
-    glGenTextures(1, &angular_frequencies_texture_);
-    glBindTexture(GL_TEXTURE_1D, angular_frequencies_texture_);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, kMaxNumWaves,
-                 0, GL_RED, GL_FLOAT, params_->angular_frequencies);
-    // I think this should setup sampling to be close enough to selecting
-    // values from the array.  I haven't thoroughly tested.
-    glTexParameterf(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    // The vector of wavenumbers is also passed as a texture.
-    glGenTextures(1, &wavenumbers_texture_);
-    glBindTexture(GL_TEXTURE_1D, wavenumbers_texture_);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, kMaxNumWaves,
-                 0, GL_RED, GL_FLOAT, params_->wavenumbers);
-    glTexParameterf(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  }
-
-  // Send our parameters down to the shader.
-  // Make sure the names match up with the variable names in the shader.
-  void UpdateShaderParams() {
-    GLint t_loc = glGetUniformLocation(shader_, "t");
-    glUniform1f(t_loc, params_->t);
-    GLint num_waves_loc = glGetUniformLocation(shader_, "num_waves");
-    glUniform1i(num_waves_loc, params_->num_waves);
-    GLint mix_loc = glGetUniformLocation(shader_, "mix");
-    glUniform1f(mix_loc, params_->mix);
-    GLint angular_frequencies_loc =
-        glGetUniformLocation(shader_, "angular_frequencies");
-    glUniform1i(angular_frequencies_loc, 0);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_1D, angular_frequencies_texture_);
-    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, kMaxNumWaves, GL_RED, GL_FLOAT,
-                    params_->angular_frequencies);
-    GLint wavenumbers_loc =
-        glGetUniformLocation(shader_, "wavenumbers");
-    glUniform1i(wavenumbers_loc, 1);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_1D, wavenumbers_texture_);
-    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, kMaxNumWaves, GL_RED, GL_FLOAT,
-    params_->wavenumbers);
-  }
-  
-  void set_shader(GLuint shader) {shader_ = shader;}
-  
- private:
-  const QCParams* params_;
-  GLuint shader_;
-  GLuint angular_frequencies_texture_;
-  GLuint wavenumbers_texture_;
-};
-
 class QCWindow : public graphics::Window2d {
  public:
   QCWindow(int width, int height, const QCParams& params)
       : Window2d(width, height, "quasicrystal"),
         params_(params),
-        shader_params_(&params_) {
+        shader_params_(&params_),
+        building_(false),
+        replay_frame_(0),
+        replay_mismatches_(0) {
+  }
+
+  // Record the session to path.  Returns false if it can not be written.
+  bool Record(const std::string& path) {
+    return recorder_.Open(path, width(), height());
+  }
+
+  // Replay frames, which should start from the parameters this window was
+  // created with, instead of taking input.
+  void Replay(const std::vector<SessionFrame>& frames) {
+    replay_ = frames;
   }
 
  protected:
@@ -175,8 +174,6 @@ class QCWindow : public graphics::Window2d {
       return false;
     }
 
-    glEnable(GL_TEXTURE_1D);
-    
     // Initialize glew and compile our shaders.
     glewInit();
     if (glewIsSupported("GL_VERSION_2_0")) {
@@ -185,19 +182,60 @@ class QCWindow : public graphics::Window2d {
       std::cout << "ERROR: OpenGL 2.0 not supported" << std::endl;
       return false;
     }
-    std::string debug;
-    if (!ShaderUtil::BuildShaderFromFile(
-            FLAGS_shader_source, GL_FRAGMENT_SHADER, &shader_, &debug)) {
+    const std::string source = ShaderUtil::ReadSource(FLAGS_shader_source);
+    if (source.empty()) {
       std::cout << "ERROR: failed to load shader from " << FLAGS_shader_source
-                << std::endl << debug;
+                << std::endl;
       return false;
     }
 
-    // Setup the bridge between our params and the shader params.
-    shader_params_.Init(shader_);
+    // Start building the shader.  Frames are drawn blank until it is ready,
+    // which from the program cache is right away.
+    if (FLAGS_shader_cache && ProgramCache::Supported()) {
+      program_cache_.reset(
+          new ProgramCache(ProgramCache::DefaultDirectory()));
+    }
+    builder_.reset(new ProgramBuilder(
+        FLAGS_background_compile ? CreateSharedContext() : nullptr,
+        program_cache_.get()));
+    shader_ = 0;
+    source_modified_ = ModificationTime(FLAGS_shader_source);
+    next_source_check_ = std::chrono::steady_clock::now();
+    BuildShader(source);
+
+    shader_params_.set_antialias(FLAGS_antialias);
+    motion_blur_ = FLAGS_motion_blur;
+
+    if (FLAGS_dynamic_resolution || FLAGS_cache_frame) {
+      if (RenderTarget::Supported()) {
+        render_target_.reset(new RenderTarget);
+      } else {
+        std::cout << "Framebuffer objects are not supported, drawing at "
+                  << "full resolution every frame" << std::endl;
+      }
+    }
+    if (FLAGS_dynamic_resolution && render_target_ != nullptr) {
+      resolution_controller_.reset(new ResolutionController(
+          1e3 / FLAGS_target_fps, FLAGS_min_resolution_scale));
+    }
+    frame_cached_ = false;
+    last_frame_ = std::chrono::steady_clock::now();
+
+    // Keep percentiles over about the last 4 seconds.
+    frame_timer_.reset(new FrameTimer(240));
+    if (!FLAGS_frame_csv.empty() && !frame_timer_->OpenLog(FLAGS_frame_csv)) {
+      std::cout << "Failed to create " << FLAGS_frame_csv << std::endl;
+    }
+    if (!frame_timer_->gpu_timing()) {
+      std::cout << "Timer queries are not supported, shader and overlay "
+                << "times are not measured" << std::endl;
+    }
+    show_frame_timer_ = FLAGS_frame_overlay;
 
     // Initialize any simulation variables outside of params.
     is_paused_ = false;
+    view_x_ = view_y_ = 0;
+    view_scale_ = 1.0f;
     dt_ = 5 * FLAGS_time_granularity;
     mixv_ = 0.0;
     
@@ -205,6 +243,34 @@ class QCWindow : public graphics::Window2d {
   }
   
   virtual void Draw() {
+    const auto frame_start = std::chrono::steady_clock::now();
+    // Leave out waiting for input or the frame rate limit, which drawing
+    // at a lower resolution would not help.
+    const double frame_ms = std::chrono::duration<double, std::milli>(
+        frame_start - last_frame_).count() - last_wait_ms();
+    last_frame_ = frame_start;
+
+    builder_->Poll();
+    if (FLAGS_reload_shader) {
+      ReloadShaderIfModified();
+    }
+    if (shader_ == 0) {
+      // Nothing to draw with yet, so hold the simulation still.
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      return;
+    }
+    frame_timer_->BeginFrame(last_swap_ms(), last_events_ms(),
+                             last_wait_ms());
+
+    const bool replaying = replay_frame_ < replay_.size();
+    if (replaying) {
+      if (replay_frame_ == 0) {
+        replay_start_ = std::chrono::steady_clock::now();
+      }
+      for (unsigned int key : replay_[replay_frame_].keys) {
+        HandleKey(key);
+      }
+    }
     if (!is_paused_) {
       params_.t += dt_;
 
@@ -219,31 +285,54 @@ class QCWindow : public graphics::Window2d {
         ++params_.num_waves;
       }
     }
-  
-    // Pass in all QC parameters to the shader.
-    shader_params_.UpdateShaderParams();
+    SessionFrame frame;
+    frame.params = params_;
+    frame.antialias = shader_params_.antialias();
+    frame.view_x = view_x_ * view_scale_;
+    frame.view_y = view_y_ * view_scale_;
+    frame.view_scale = view_scale_;
+    // A still frame has no motion to blur.
+    frame.shutter = motion_blur_ && !is_paused_ ?
+                    dt_ * FLAGS_shutter_angle / 360.0 : 0.0f;
+    if (replaying) {
+      if (!SameFrame(frame, replay_[replay_frame_++])) {
+        ++replay_mismatches_;
+      }
+      if (replay_frame_ == replay_.size()) {
+        FinishReplay();
+      }
+    }
+    recorder_.AddFrame(frame);
+    shader_params_.set_shutter(frame.shutter);
 
-    // Reset drawing state.
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glLoadIdentity();
+    if (variants_.get() != nullptr) {
+      const GLuint program = variants_->Program(NumMixedWaves(params_));
+      if (program != shader_params_.shader()) {
+        shader_params_.set_shader(program);
+      }
+    }
 
-    // Draw our canvas, this should invoke the shaders.
-    glBegin(GL_QUADS);
-    glVertex2i(0, 0);
-    glVertex2i(width(), 0);
-    glVertex2i(width(), height());
-    glVertex2i(0, height());
-    glEnd();
+    shader_params_.set_view(frame.view_x, frame.view_y, frame.view_scale);
 
-    if (af_adjuster.get() != nullptr || wn_adjuster.get() != nullptr) {
-      // TODO(piotrf): this is really a terrible way to disable the shader,
-      // figure out a cleaner way.
-      glUseProgram(0);
-      // Disable textures so that we can just draw with colors.
-      glActiveTexture(GL_TEXTURE0);
-      glDisable(GL_TEXTURE_1D);
-      glActiveTexture(GL_TEXTURE1);
-      glDisable(GL_TEXTURE_1D);
+    // Only run the shader if the render target does not already hold this
+    // frame, and then only where it does not hold it shifted.
+    frame_timer_->Mark(FrameTimer::kShaderStart);
+    int dx, dy;
+    if (FrameCached()) {
+      frame_timer_->Record(FrameTimer::kUpload, 0.0);
+    } else if (!CachedFrameShift(&dx, &dy) || !ShiftCachedFrame(dx, dy)) {
+      DrawQuasicrystal(frame_ms);
+    }
+
+    // The overlay below is drawn at the window's own resolution.
+    if (render_target_ != nullptr) {
+      render_target_->Present(cached_width_, cached_height_, width(),
+                              height());
+    }
+    frame_timer_->Mark(FrameTimer::kShaderEnd);
+
+    if (af_adjuster.get() != nullptr || wn_adjuster.get() != nullptr ||
+        show_frame_timer_) {
       glPushMatrix();
       glScalef(width(), height(), 1.0);
       if (af_adjuster.get() != nullptr) {
@@ -251,25 +340,188 @@ class QCWindow : public graphics::Window2d {
       } else if (wn_adjuster.get() != nullptr) {
         wn_adjuster->Draw();
       }
+      if (show_frame_timer_) {
+        frame_timer_->Draw(1e3 / FLAGS_target_fps);
+      }
       glPopMatrix();
-      // Re-enable textures so that we can just draw with colors.
-      glActiveTexture(GL_TEXTURE0);
-      glDisable(GL_TEXTURE_1D);
-      glActiveTexture(GL_TEXTURE1);
-      glDisable(GL_TEXTURE_1D);
-      glUseProgram(shader_);
     }
+    frame_timer_->Mark(FrameTimer::kOverlayEnd);
   }
 
   virtual void Resize(int width, int height) {
     Window2d::Resize(width, height);
-    // Update resolution in shader.
-    GLint resolution_loc = glGetUniformLocation(shader_, "resolution");
-    glUniform2f(resolution_loc, static_cast<float>(width),
-                static_cast<float>(height));
+    shader_params_.set_resolution(width, height);
+    if (render_target_ != nullptr &&
+        !render_target_->Resize(width, height)) {
+      std::cout << "Failed to create a " << width << "x" << height
+                << " framebuffer, drawing at full resolution every frame"
+                << std::endl;
+      render_target_.reset();
+      resolution_controller_.reset();
+    }
+    spare_target_.reset();
+    frame_cached_ = false;
+  }
+
+  virtual bool Animating() {
+    // Frames only change by themselves while running, and are held still
+    // until the shader is built, which Idle() polls for.
+    return shader_ != 0 && (!is_paused_ || replay_frame_ < replay_.size());
+  }
+
+  virtual void Idle() {
+    builder_->Poll();
+    if (FLAGS_reload_shader) {
+      ReloadShaderIfModified();
+    }
   }
 
   virtual void Keypress(unsigned int key) {
+    if (!replay_.empty()) {
+      // Only let the user stop a replay.
+      if (key == XK_Escape) {
+        Close();
+      }
+      return;
+    }
+    recorder_.AddKey(key);
+    HandleKey(key);
+  }
+
+ private:
+  // Whether the render target holds the frame that would be drawn now.
+  // While paused that has to be at full resolution, so that a frame drawn
+  // small to keep up with the animation is not left on screen.
+  bool FrameCached() const {
+    int dx, dy;
+    return CachedFrameShift(&dx, &dy) && dx == 0 && dy == 0;
+  }
+
+  // Whether the render target holds the frame that would be drawn now, at
+  // full resolution, apart from being panned by dx, dy pixels.
+  bool CachedFrameShift(int* dx, int* dy) const {
+    *dx = view_x_ - cached_view_x_;
+    *dy = view_y_ - cached_view_y_;
+    const bool moved = *dx != 0 || *dy != 0;
+    const bool full_resolution =
+        cached_width_ == width() && cached_height_ == height();
+    return render_target_ != nullptr && frame_cached_ &&
+           SameParams(params_, cached_params_) &&
+           shader_params_.antialias() == cached_antialias_ &&
+           shader_params_.shutter() == cached_shutter_ &&
+           shader_params_.shader() == cached_shader_ &&
+           view_scale_ == cached_view_scale_ &&
+           (full_resolution || !is_paused_) &&
+           (!moved || (full_resolution && std::abs(*dx) < width() &&
+                       std::abs(*dy) < height()));
+  }
+
+  // Move the frame in the render target by dx, dy pixels, through the spare
+  // target, and draw just the strips uncovered at the edges.  Returns false
+  // if there is no spare target.
+  bool ShiftCachedFrame(int dx, int dy) {
+    if (spare_target_ == nullptr) {
+      spare_target_.reset(new RenderTarget);
+      if (!spare_target_->Resize(width(), height())) {
+        spare_target_.reset();
+        return false;
+      }
+    }
+    render_target_->CopyShifted(spare_target_.get(), width(), height(), dx,
+                                dy);
+    std::swap(render_target_, spare_target_);
+    render_target_->Bind(width(), height());
+    shader_params_.set_pixel_size(1.0f, 1.0f);
+    glUseProgram(shader_params_.shader());
+    const auto upload_start = std::chrono::steady_clock::now();
+    shader_params_.UpdateShaderParams();
+    frame_timer_->Record(
+        FrameTimer::kUpload,
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - upload_start).count());
+    glLoadIdentity();
+    glEnable(GL_SCISSOR_TEST);
+    if (dx != 0) {
+      glScissor(dx > 0 ? width() - dx : 0, 0, std::abs(dx), height());
+      DrawCanvas();
+    }
+    if (dy != 0) {
+      glScissor(0, dy > 0 ? height() - dy : 0, width(), std::abs(dy));
+      DrawCanvas();
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glUseProgram(0);
+    cached_view_x_ = view_x_;
+    cached_view_y_ = view_y_;
+    return true;
+  }
+
+  // Draw our canvas over the whole window, this should invoke the shaders.
+  void DrawCanvas() {
+    glBegin(GL_QUADS);
+    glVertex2i(0, 0);
+    glVertex2i(width(), 0);
+    glVertex2i(width(), height());
+    glVertex2i(0, height());
+    glEnd();
+  }
+
+  // Run the shader over the window, or over the render target if there is
+  // one, at a resolution chosen from frame_ms if it is dynamic and the
+  // animation is running.
+  void DrawQuasicrystal(double frame_ms) {
+    int draw_width = width(), draw_height = height();
+    if (resolution_controller_ != nullptr && !is_paused_) {
+      const double scale = resolution_controller_->Update(frame_ms);
+      draw_width = std::max(1, static_cast<int>(std::lround(scale * width())));
+      draw_height =
+          std::max(1, static_cast<int>(std::lround(scale * height())));
+    }
+    if (render_target_ != nullptr) {
+      render_target_->Bind(draw_width, draw_height);
+    }
+    shader_params_.set_pixel_size(
+        static_cast<float>(width()) / draw_width,
+        static_cast<float>(height()) / draw_height);
+
+    // Pass in all QC parameters to the shader.
+    glUseProgram(shader_params_.shader());
+    const auto upload_start = std::chrono::steady_clock::now();
+    shader_params_.UpdateShaderParams();
+    frame_timer_->Record(
+        FrameTimer::kUpload,
+        std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - upload_start).count());
+
+    // Reset drawing state.
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glLoadIdentity();
+
+    DrawCanvas();
+    glUseProgram(0);
+
+    frame_cached_ = true;
+    cached_params_ = params_;
+    cached_antialias_ = shader_params_.antialias();
+    cached_shutter_ = shader_params_.shutter();
+    cached_shader_ = shader_params_.shader();
+    cached_width_ = draw_width;
+    cached_height_ = draw_height;
+    cached_view_x_ = view_x_;
+    cached_view_y_ = view_y_;
+    cached_view_scale_ = view_scale_;
+  }
+
+  // Zoom in by factor about the center of the window, keeping the pan a
+  // whole number of pixels.
+  void Zoom(float factor) {
+    view_scale_ /= factor;
+    view_x_ = static_cast<int>(std::lround(view_x_ * factor));
+    view_y_ = static_cast<int>(std::lround(view_y_ * factor));
+  }
+
+  // Apply a key press, from the user or a replayed session.
+  void HandleKey(unsigned int key) {
     switch (key) {
       case XK_bracketleft:
         if (af_adjuster.get() != nullptr) {
@@ -402,32 +654,208 @@ class QCWindow : public graphics::Window2d {
           wn_adjuster->Hide();
         }
         break;
+      case XK_z: case XK_Z:
+        shader_params_.set_antialias(!shader_params_.antialias());
+        break;
+      case XK_b: case XK_B:
+        motion_blur_ = !motion_blur_;
+        break;
+      case XK_Left:
+        view_x_ -= std::max(1, width() / 8);
+        break;
+      case XK_Right:
+        view_x_ += std::max(1, width() / 8);
+        break;
+      case XK_Down:
+        view_y_ -= std::max(1, height() / 8);
+        break;
+      case XK_Up:
+        view_y_ += std::max(1, height() / 8);
+        break;
+      case XK_Page_Up:
+        Zoom(1.25f);
+        break;
+      case XK_Page_Down:
+        Zoom(0.8f);
+        break;
+      case XK_Home:
+        view_x_ = view_y_ = 0;
+        view_scale_ = 1.0f;
+        break;
+      case XK_f: case XK_F:
+        show_frame_timer_ = !show_frame_timer_;
+        break;
       default:
         break;
     }
   }
 
- private:
-  GLuint shader_;                  // Shader program handle.
+  // The last modification time of the file at path, or 0 if there is none.
+  static time_t ModificationTime(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_mtime : 0;
+  }
+
+  // Build a program from source, and draw with it once it is built.
+  void BuildShader(const std::string& source) {
+    building_ = true;
+    UpdateIdleInterval();
+    builder_->Build(source, [this, source](GLuint program,
+                                           const std::string& debug) {
+      building_ = false;
+      UpdateIdleInterval();
+      if (program == 0) {
+        std::cout << "ERROR: failed to build shader from "
+                  << FLAGS_shader_source << std::endl << debug;
+        return;
+      }
+      // Variants of the old program are of no more use.
+      variants_.reset();
+      if (shader_ != 0) {
+        glDeleteProgram(shader_);
+      }
+      shader_ = program;
+      if (FLAGS_shader_variants) {
+        variants_.reset(new ShaderVariants(builder_.get(), source, shader_));
+      }
+      shader_params_.set_shader(shader_);
+      Redraw();
+    });
+  }
+
+  // While waiting for events, poll for a program being built every few
+  // milliseconds, and with --reload_shader, keep checking the shader source
+  // a few times a second.
+  void UpdateIdleInterval() {
+    set_idle_interval_ms(building_ ? 5 : FLAGS_reload_shader ? 500 : 0);
+  }
+
+  // Rebuild the shader if its source changed, checking at most a few times
+  // a second.
+  void ReloadShaderIfModified() {
+    const auto now = std::chrono::steady_clock::now();
+    if (now < next_source_check_) {
+      return;
+    }
+    next_source_check_ = now + std::chrono::milliseconds(500);
+    const time_t modified = ModificationTime(FLAGS_shader_source);
+    if (modified == source_modified_) {
+      return;
+    }
+    source_modified_ = modified;
+    const std::string source = ShaderUtil::ReadSource(FLAGS_shader_source);
+    if (!source.empty()) {
+      std::cout << "Reloading " << FLAGS_shader_source << std::endl;
+      BuildShader(source);
+    }
+  }
+
+  // Report how the replay went, and end it.
+  void FinishReplay() {
+    // Includes waiting for the last frame but one to be shown; the last
+    // frame is still being drawn.
+    glFinish();
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - replay_start_).count();
+    std::cout << "Replayed " << replay_.size() << " frames in " << seconds
+              << " s, " << 1e3 * seconds / replay_.size() << " ms per frame"
+              << std::endl;
+    if (replay_mismatches_ > 0) {
+      std::cout << "WARNING: " << replay_mismatches_
+                << " frames differ from the recording" << std::endl;
+    }
+    Close();
+  }
+
+  GLuint shader_;                  // Generic shader program handle.
   QCParams params_;                // Mathematical params for the quasicrystal.
   QCShaderParams shader_params_;   // Link between our params and shader.
   bool is_paused_;                 // Is the simulation paused or not?
   float dt_, mixv_;                // Time step, mixing velocity.
+  bool motion_blur_;               // Blur over part of each time step?
+  // Pan, in screen pixels, and plane units per screen pixel.
+  int view_x_, view_y_;
+  float view_scale_;
 
   // GUI element for adjusting angular frequencies.
   std::unique_ptr<ArrayAdjuster> af_adjuster;
   // GUI element for adjutsing wavenumbers.
   std::unique_ptr<ArrayAdjuster> wn_adjuster;
+
+  // Builds programs, loading them from the cache if there is one.
+  std::unique_ptr<ProgramCache> program_cache_;
+  std::unique_ptr<ProgramBuilder> builder_;
+  // Whether a program from BuildShader is still being built.
+  bool building_;
+  // Programs specialized to the number of waves, if enabled.
+  std::unique_ptr<ShaderVariants> variants_;
+  // Offscreen target, with --dynamic_resolution or --cache_frame, and the
+  // resolution to draw at, with --dynamic_resolution.
+  std::unique_ptr<RenderTarget> render_target_;
+  std::unique_ptr<ResolutionController> resolution_controller_;
+  // The target the frame moves to when panning while paused.
+  std::unique_ptr<RenderTarget> spare_target_;
+  // Whether the render target holds a frame, and what it was drawn with.
+  bool frame_cached_;
+  QCParams cached_params_;
+  bool cached_antialias_;
+  float cached_shutter_;
+  int cached_view_x_, cached_view_y_;
+  float cached_view_scale_;
+  GLuint cached_shader_;
+  int cached_width_, cached_height_;
+  // When the last frame started.
+  std::chrono::steady_clock::time_point last_frame_;
+  // Times of the parts of each frame, and whether to show them.
+  std::unique_ptr<FrameTimer> frame_timer_;
+  bool show_frame_timer_;
+  // When the shader source was last changed, and when to next check.
+  time_t source_modified_;
+  std::chrono::steady_clock::time_point next_source_check_;
+
+  // Session being recorded, if any.
+  SessionWriter recorder_;
+  // Session being replayed, if any, and the next frame of it.
+  std::vector<SessionFrame> replay_;
+  size_t replay_frame_;
+  int replay_mismatches_;
+  std::chrono::steady_clock::time_point replay_start_;
 };
 
 }  // namespace quasicrystal
 
 int main(int argc, char **argv) {
   google::ParseCommandLineFlags(&argc, &argv, true);
+  if (!FLAGS_trace.empty()) {
+    quasicrystal::trace::Start();
+  }
+
+  int width = FLAGS_width, height = FLAGS_height;
+  std::vector<quasicrystal::SessionFrame> session;
+  if (!FLAGS_replay.empty()) {
+    if (!quasicrystal::ReadSession(FLAGS_replay, &width, &height, &session) ||
+        session.empty()) {
+      std::cerr << "Failed to read session " << FLAGS_replay << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
 
   quasicrystal::QCWindow window(
-      FLAGS_width, FLAGS_height, quasicrystal::InitQCParamsFromFlags());
+      width, height, quasicrystal::InitQCParamsFromFlags());
+  if (!FLAGS_record.empty() && !window.Record(FLAGS_record)) {
+    std::cerr << "Failed to create " << FLAGS_record << std::endl;
+    return EXIT_FAILURE;
+  }
+  window.Replay(session);
+  if (FLAGS_swap_interval >= 0) {
+    window.set_swap_interval(FLAGS_swap_interval);
+  }
+  window.set_max_fps(FLAGS_max_fps);
   window.Run();
+
+  if (!FLAGS_trace.empty() && !quasicrystal::trace::WriteJson(FLAGS_trace)) {
+    std::cerr << "Failed to write " << FLAGS_trace << std::endl;
+  }
   
   return EXIT_SUCCESS;
 }
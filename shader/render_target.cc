@@ -0,0 +1,61 @@
+#include "render_target.h"
+
+#include <algorithm>
+
+namespace quasicrystal {
+
+RenderTarget::RenderTarget() {
+  glGenFramebuffers(1, &framebuffer_);
+  glGenRenderbuffers(1, &color_);
+}
+
+RenderTarget::~RenderTarget() {
+  glDeleteRenderbuffers(1, &color_);
+  glDeleteFramebuffers(1, &framebuffer_);
+}
+
+bool RenderTarget::Supported() {
+  return GLEW_ARB_framebuffer_object;
+}
+
+bool RenderTarget::Resize(int width, int height) {
+  glBindRenderbuffer(GL_RENDERBUFFER, color_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color_);
+  const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                        GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  return complete;
+}
+
+void RenderTarget::Bind(int width, int height) {
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+  glViewport(0, 0, width, height);
+}
+
+void RenderTarget::CopyShifted(RenderTarget* target, int width,
+                               int height, int dx, int dy) const {
+  const int x0 = std::max(0, -dx), x1 = std::min(width, width - dx);
+  const int y0 = std::max(0, -dy), y1 = std::min(height, height - dy);
+  if (x0 < x1 && y0 < y1) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->framebuffer_);
+    glBlitFramebuffer(x0 + dx, y0 + dy, x1 + dx, y1 + dy, x0, y0, x1, y1,
+                      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+}
+
+void RenderTarget::Present(int width, int height, int window_width,
+                           int window_height) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, window_width, window_height,
+                    GL_COLOR_BUFFER_BIT, GL_LINEAR);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, window_width, window_height);
+}
+
+}  // namespace quasicrystal
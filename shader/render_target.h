@@ -0,0 +1,45 @@
+// An offscreen framebuffer to draw frames into at less than the window's
+// resolution, and then scale up to fill the window.  The frame stays in it
+// after being shown, so it can be shown again without drawing it again.
+// Requires GL_ARB_framebuffer_object.
+
+#ifndef QUASICRYSTAL_RENDER_TARGET_H
+#define QUASICRYSTAL_RENDER_TARGET_H
+
+#include <GL/glew.h>
+
+namespace quasicrystal {
+
+class RenderTarget {
+ public:
+  RenderTarget();
+  ~RenderTarget();
+
+  // Whether this build of GL has what RenderTarget needs.
+  static bool Supported();
+
+  // Make room for frames of up to width x height.  Returns false if the
+  // framebuffer can not be drawn to.
+  bool Resize(int width, int height);
+
+  // Draw into the width x height corner of the target, which must fit.
+  void Bind(int width, int height);
+
+  // Copy the width x height corner to the same corner of target, shifted so
+  // that its pixel (x, y) is pixel (x + dx, y + dy) of this one.  Pixels of
+  // target with nothing to copy to them are left as they were.
+  void CopyShifted(RenderTarget* target, int width, int height, int dx,
+                   int dy) const;
+
+  // Scale the width x height corner up to fill the window, of
+  // window_width x window_height, and go back to drawing to the window.
+  void Present(int width, int height, int window_width, int window_height);
+
+ private:
+  GLuint framebuffer_;
+  GLuint color_;
+};
+
+}  // namespace quasicrystal
+
+#endif
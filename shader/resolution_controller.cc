@@ -0,0 +1,55 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace quasicrystal {
+
+namespace {
+
+// Weight of the newest frame in the smoothed frame time.
+const double kSmoothing = 0.2;
+
+// Frames within this fraction of the target leave the scale alone.
+const double kDeadband = 0.1;
+
+// Largest changes of the scale from one frame to the next.  Coming down is
+// quicker, since slow frames are the more noticeable.
+const double kMaxStepDown = 0.8;
+const double kMaxStepUp = 1.05;
+
+// Scales are multiples of 1 / kScaleSteps.
+const double kScaleSteps = 32.0;
+
+}  // namespace
+
+ResolutionController::ResolutionController(double target_ms,
+                                           double min_scale)
+    : target_ms_(target_ms),
+      min_scale_(std::min(1.0, std::max(1.0 / kScaleSteps, min_scale))),
+      scale_(1.0),
+      smoothed_ms_(0.0) {
+}
+
+double ResolutionController::Update(double frame_ms) {
+  smoothed_ms_ = smoothed_ms_ == 0.0 ?
+      frame_ms : smoothed_ms_ + kSmoothing * (frame_ms - smoothed_ms_);
+  if (std::abs(smoothed_ms_ - target_ms_) <= kDeadband * target_ms_) {
+    return scale_;
+  }
+  double scale = scale_ * std::sqrt(target_ms_ / smoothed_ms_);
+  scale = std::min(kMaxStepUp * scale_,
+                   std::max(kMaxStepDown * scale_, scale));
+  // Round away from the current scale, so that small steps still move.
+  scale = (scale > scale_ ? std::ceil(scale * kScaleSteps) :
+                            std::floor(scale * kScaleSteps)) / kScaleSteps;
+  scale = std::min(1.0, std::max(min_scale_, scale));
+  if (scale != scale_) {
+    // Expect the next frames to take as long as the new scale would have.
+    smoothed_ms_ *= (scale * scale) / (scale_ * scale_);
+    scale_ = scale;
+  }
+  return scale_;
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,35 @@
+// Chooses the resolution to draw frames at so that they take about a
+// target time.  The time to draw a frame mostly goes with its number of
+// pixels, so the controller scales both axes by the square root of how far
+// off target the recent frames were.  It changes the scale in small steps,
+// and not at all while frames are close to the target, so that the image
+// does not visibly pump.
+
+#ifndef QUASICRYSTAL_RESOLUTION_CONTROLLER_H
+#define QUASICRYSTAL_RESOLUTION_CONTROLLER_H
+
+namespace quasicrystal {
+
+class ResolutionController {
+ public:
+  // Aim for frames of target_ms, drawn at between min_scale and 1 times
+  // the window's resolution along each axis.
+  ResolutionController(double target_ms, double min_scale);
+
+  // Given how long the last frame took, return the scale to draw the next
+  // one at.
+  double Update(double frame_ms);
+
+  double scale() const { return scale_; }
+
+ private:
+  double target_ms_;
+  double min_scale_;
+  double scale_;
+  // Recent frame times, smoothed, or 0 before the first.
+  double smoothed_ms_;
+};
+
+}  // namespace quasicrystal
+
+#endif
@@ -43,41 +43,96 @@ bool ShaderUtil::BuildShader(const std::string& source,
                              const GLenum type,
                              GLuint* program,
                              std::string* debug) {
+  const GLuint built = StartBuildShader(source, type);
+  if (!FinishBuildShader(built, debug)) {
+    return false;
+  }
+  *program = built;
+  glUseProgram(*program);
+  return true;
+}
 
+bool ShaderUtil::BuildShaderFromFile(const std::string& filename,
+                                     const GLenum type,
+                                     GLuint* program,
+                                     std::string* debug) {
+  return BuildShader(ReadSource(filename), type, program, debug);
+}
+
+GLuint ShaderUtil::StartBuildShader(const std::string& source,
+                                    const GLenum type) {
   GLuint f = glCreateShader(type);
   const char* source_cstr = source.c_str();
   glShaderSource(f, 1, &source_cstr, nullptr);
+  glCompileShader(f);
+
+  // Link without waiting for the compile; a failed compile fails the link,
+  // and the shader's log is read then.
+  GLuint program = glCreateProgram();
+  glAttachShader(program, f);
+  if (GLEW_ARB_get_program_binary) {
+    // So that the program can be cached.
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glLinkProgram(program);
+  return program;
+}
+
+bool ShaderUtil::IsBuildComplete(GLuint program) {
+  if (!GLEW_ARB_parallel_shader_compile) {
+    return true;
+  }
+  GLint complete;
+  glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &complete);
+  return complete == GL_TRUE;
+}
+
+bool ShaderUtil::FinishBuildShader(GLuint program, std::string* debug) {
+  GLuint f;
+  GLsizei count = 0;
+  glGetAttachedShaders(program, 1, &count, &f);
 
   GLint status;
-  glCompileShader(f);
   glGetShaderiv(f, GL_COMPILE_STATUS, &status);
   if (status == GL_FALSE) {
     GetShaderInfoLog(f, debug);
-    return false;
+  } else {
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+      GetProgramInfoLog(program, debug);
+    }
   }
-
-  *program = glCreateProgram();
-  glAttachShader(*program, f);
-
-  glLinkProgram(*program);
-  glGetProgramiv(*program, GL_LINK_STATUS, &status);
+  // The linked program keeps what it needs of the shader.
+  glDetachShader(program, f);
+  glDeleteShader(f);
   if (status == GL_FALSE) {
-    GetProgramInfoLog(*program, debug);
+    glDeleteProgram(program);
     return false;
   }
-
-  glUseProgram(*program);
   return true;
 }
 
-bool ShaderUtil::BuildShaderFromFile(const std::string& filename,
-                                     const GLenum type,
-                                     GLuint* program,
-                                     std::string* debug) {
+std::string ShaderUtil::AddDefines(const std::string& source,
+                                   const std::vector<std::string>& defines) {
+  std::string lines;
+  for (const std::string& define : defines) {
+    lines += "#define " + define + "\n";
+  }
+  // #version must stay the first thing in the source.
+  size_t position = 0;
+  if (source.compare(0, 8, "#version") == 0) {
+    position = source.find('\n');
+    position = position == std::string::npos ? source.size() : position + 1;
+  }
+  std::string result = source;
+  result.insert(position, lines);
+  return result;
+}
+
+std::string ShaderUtil::ReadSource(const std::string& filename) {
   std::ifstream infile(filename);
-  std::string source((std::istreambuf_iterator<char>(infile)),
+  return std::string((std::istreambuf_iterator<char>(infile)),
                      std::istreambuf_iterator<char>());
-  return BuildShader(source, type, program, debug);
 }
 
 }  // namespace graphics
@@ -4,6 +4,7 @@
 #define QUASICRYSTAL_SHADER_UTIL_H
 
 #include <string>
+#include <vector>
 
 #include <GL/glew.h>
 
@@ -27,6 +28,30 @@ class ShaderUtil {
                                   GLuint* program,
                                   std::string* debug = nullptr);
 
+  // Start compiling and linking the source of a shader into a new program,
+  // and return the program.  Where GL_ARB_parallel_shader_compile is
+  // supported the driver builds it on its own threads; otherwise this waits
+  // for the build.
+  static GLuint StartBuildShader(const std::string& source, const GLenum type);
+
+  // Whether the build of a program from StartBuildShader has finished, so
+  // that FinishBuildShader will not wait for it.
+  static bool IsBuildComplete(GLuint program);
+
+  // Wait for the build of a program from StartBuildShader, and return
+  // whether it succeeded.  If it failed, the program is deleted, and if
+  // debug is not null then debug will contain any error messages.
+  static bool FinishBuildShader(GLuint program, std::string* debug = nullptr);
+
+  // Return source with "#define <define>" lines for each of defines, for
+  // example "WAVE_COUNT 7", inserted after its #version line if it has one.
+  static std::string AddDefines(const std::string& source,
+                                const std::vector<std::string>& defines);
+
+  // Read the source of a shader from a file.  Returns an empty string if it
+  // can not be read.
+  static std::string ReadSource(const std::string& filename);
+
   // TODO(piotrf): functions for compiling and linking into an existing
   // program.
 };
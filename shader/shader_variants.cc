@@ -0,0 +1,70 @@
+#include "shader_variants.h"
+
+#include <iostream>
+
+#include "common/qc_params.h"
+#include "shader_util.h"
+
+using graphics::ShaderUtil;
+
+namespace quasicrystal {
+
+ShaderVariants::ShaderVariants(ProgramBuilder* builder,
+                               const std::string& source, GLuint generic)
+    : builder_(builder),
+      source_(source),
+      generic_(generic),
+      variants_(new std::vector<Variant>(kMaxNumWaves + 1)) {
+}
+
+ShaderVariants::~ShaderVariants() {
+  for (const Variant& variant : *variants_) {
+    if (variant.state == kReady) {
+      glDeleteProgram(variant.program);
+    }
+  }
+}
+
+GLuint ShaderVariants::Program(int wave_count) {
+  if (wave_count < 1 || wave_count > kMaxNumWaves) {
+    return generic_;
+  }
+  for (int neighbour = wave_count - 1; neighbour <= wave_count + 1;
+       ++neighbour) {
+    if (neighbour >= 1 && neighbour <= kMaxNumWaves &&
+        (*variants_)[neighbour].state == kNotBuilt) {
+      StartBuild(neighbour);
+    }
+  }
+  const Variant& variant = (*variants_)[wave_count];
+  return variant.state == kReady ? variant.program : generic_;
+}
+
+void ShaderVariants::StartBuild(int wave_count) {
+  const std::vector<std::string> defines(
+      1, "WAVE_COUNT " + std::to_string(wave_count));
+  (*variants_)[wave_count].state = kBuilding;
+  std::weak_ptr<std::vector<Variant>> weak_variants = variants_;
+  builder_->Build(
+      ShaderUtil::AddDefines(source_, defines),
+      [weak_variants, wave_count](GLuint program, const std::string& debug) {
+        std::shared_ptr<std::vector<Variant>> variants = weak_variants.lock();
+        if (variants == nullptr) {
+          if (program != 0) {
+            glDeleteProgram(program);
+          }
+          return;
+        }
+        Variant& variant = (*variants)[wave_count];
+        if (program != 0) {
+          variant.state = kReady;
+          variant.program = program;
+        } else {
+          std::cout << "ERROR: failed to build the shader for " << wave_count
+                    << " waves, using the generic one" << std::endl << debug;
+          variant.state = kFailed;
+        }
+      });
+}
+
+}  // namespace quasicrystal
@@ -0,0 +1,62 @@
+// Programs built from the quasicrystal fragment shader specialized to one
+// wave count each.  The shader is compiled with WAVE_COUNT defined, so that
+// its wave loop has a constant bound the compiler can unroll, and its wave
+// table is no larger than it needs to be.
+//
+// Variants are built when first asked for, along with the wave counts on
+// either side of it, which are the ones [ and ] switch to next.  They are
+// built by a ProgramBuilder, and until a variant is ready the generic
+// program, with the wave count as a uniform, is used instead.
+
+#ifndef QUASICRYSTAL_SHADER_VARIANTS_H
+#define QUASICRYSTAL_SHADER_VARIANTS_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "program_builder.h"
+
+namespace quasicrystal {
+
+class ShaderVariants {
+ public:
+  // Variants of the fragment shader source, built with builder, falling
+  // back to generic, which was built from it without specializing.
+  ShaderVariants(ProgramBuilder* builder, const std::string& source,
+                 GLuint generic);
+  ~ShaderVariants();
+
+  // The program to draw wave_count waves with.  Starts building its
+  // variant and those of its neighbours if need be.
+  GLuint Program(int wave_count);
+
+ private:
+  enum State {
+    kNotBuilt,
+    kBuilding,
+    kReady,
+    kFailed,
+  };
+
+  struct Variant {
+    Variant() : state(kNotBuilt), program(0) {}
+    State state;
+    GLuint program;
+  };
+
+  void StartBuild(int wave_count);
+
+  ProgramBuilder* builder_;
+  std::string source_;
+  GLuint generic_;
+  // Indexed by wave count.  Shared with the callbacks of builds in
+  // progress, which find it gone if these variants are replaced first.
+  std::shared_ptr<std::vector<Variant>> variants_;
+};
+
+}  // namespace quasicrystal
+
+#endif
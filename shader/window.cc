@@ -1,10 +1,17 @@
 #include "window.h"
 
+#include <chrono>
 #include <iostream>
+#include <thread>
+
+#include <poll.h>
 
 #include <GL/gl.h>
 #include <GL/glx.h>
 
+#include "common/trace.h"
+#include "extensions.h"
+
 namespace graphics {
 
 // A structure capturing all the state for an OpenGL window through GLX.
@@ -13,6 +20,7 @@ struct GLWindow {
   int                     screen;
   ::Window                win;
   GLXContext              ctx;
+  XVisualInfo            *vi;
   XSetWindowAttributes    attr;
   unsigned int            bpp;
   int                     x,y;
@@ -24,6 +32,10 @@ struct GLWindow {
 GLWindow* CreateGLWindow(const int width, const int height,
                          const std::string& title) {
   GLWindow* gl_win = new GLWindow();
+
+  // Let shared contexts use the display from other threads.  This has to
+  // come before any other Xlib call.
+  XInitThreads();
   
     // Open a display connection to the server.
   gl_win->dpy = XOpenDisplay(0);
@@ -50,6 +62,8 @@ GLWindow* CreateGLWindow(const int width, const int height,
     vi = glXChooseVisual(gl_win->dpy, gl_win->screen, attrListSgl);
   }
   
+  gl_win->vi = vi;
+  
   // Create a GLX graphics context, the opengl drawing machine.
   gl_win->ctx = glXCreateContext(gl_win->dpy, vi, 0, GL_TRUE);
 
@@ -112,13 +126,67 @@ void DestroyGLWindow(GLWindow* gl_win) {
     gl_win->ctx = nullptr;
   }
 
+  XFree(gl_win->vi);
+
   // Close the display connection.
   XCloseDisplay(gl_win->dpy);
 }
 
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double Milliseconds(Clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+// Sleep until deadline.  Sleeps can overrun by a scheduler tick or more, so
+// the last stretch is waited out by yielding instead.
+void SleepUntil(Clock::time_point deadline) {
+  const Clock::duration kSpin = std::chrono::milliseconds(1);
+  if (Clock::now() < deadline - kSpin) {
+    std::this_thread::sleep_until(deadline - kSpin);
+  }
+  while (Clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
+
+// A context sharing objects with a window's, made current on a hidden
+// window of its own so that it never competes for the visible one.
+class GLXSharedContext : public SharedContext {
+ public:
+  GLXSharedContext(Display* dpy, ::Window win, GLXContext ctx)
+      : dpy_(dpy), win_(win), ctx_(ctx) {
+  }
+  virtual ~GLXSharedContext() {
+    glXDestroyContext(dpy_, ctx_);
+    XDestroyWindow(dpy_, win_);
+  }
+
+  virtual bool MakeCurrent(bool current) {
+    return current ? glXMakeCurrent(dpy_, win_, ctx_) :
+                     glXMakeCurrent(dpy_, None, nullptr);
+  }
+
+ private:
+  Display* dpy_;
+  ::Window win_;
+  GLXContext ctx_;
+};
+
+}  // namespace
+
 Window::Window(int width, int height, const std::string& title)
     : gl_win_(CreateGLWindow(width, height, title)),
-      running_(false) {
+      running_(false),
+      redraw_(true),
+      swap_interval_(-1),
+      max_fps_(0.0),
+      idle_interval_ms_(0),
+      last_events_ms_(0.0),
+      last_swap_ms_(0.0),
+      last_wait_ms_(0.0) {
 }
 
 Window::~Window() {
@@ -129,6 +197,10 @@ void Window::Run() {
   // Attach the GLX context to our window.  This must be done in the thread
   // where we'll be doing our rendering.
   glXMakeCurrent(gl_win_->dpy, gl_win_->win, gl_win_->ctx);
+  quasicrystal::trace::SetThreadName("main");
+  if (swap_interval_ >= 0 && !ApplySwapInterval()) {
+    std::cout << "Swap interval can not be changed" << std::endl;
+  }
   
   // Start by initializing any custom application context, and then ensuring
   // that the OpenGL projection is correctly set to our window size.
@@ -139,38 +211,140 @@ void Window::Run() {
 
   // Main application event loop.
   running_ = true;
+  redraw_ = true;
+  double wait_ms = 0.0;
+  Clock::time_point next_frame = Clock::now();
   while (running_) {
-    // Handle any pending events.
-    while (XPending(gl_win_->dpy) > 0) {
-      XEvent event;
-      XNextEvent(gl_win_->dpy, &event);
-      switch (event.type) {
-        case ConfigureNotify:
-          if ((static_cast<unsigned int>(event.xconfigure.width) !=
-               gl_win_->width) ||
-              (static_cast<unsigned int>(event.xconfigure.height) !=
-               gl_win_->height)) {
-            gl_win_->width = event.xconfigure.width;
-            gl_win_->height = event.xconfigure.height;
-            Resize(gl_win_->width, gl_win_->height);
-          }
-          break;
-        case ClientMessage:
-          if (*XGetAtomName(gl_win_->dpy, event.xclient.message_type) ==
-              *"WM_PROTOCOLS") {
-            running_ = false;
-          }
-          break;
-        case KeyPress:
-          KeySym keysym;
-          XLookupString(&event.xkey, nullptr, 0, &keysym, nullptr);
-          Keypress(keysym);
-          break;
+    const Clock::time_point start = Clock::now();
+    HandleEvents();
+    if (running_ && !redraw_ && !Animating()) {
+      // Nothing would change, so sleep until something does.
+      TRACE_SPAN("WaitForEvents");
+      if (!WaitForEvents(idle_interval_ms_)) {
+        Idle();
       }
+      wait_ms += Milliseconds(Clock::now() - start);
+      continue;
+    }
+    last_events_ms_ = Milliseconds(Clock::now() - start);
+    last_wait_ms_ = wait_ms;
+    wait_ms = 0.0;
+    redraw_ = false;
+    {
+      TRACE_SPAN("Draw");
+      Draw();
     }
+    {
+      TRACE_SPAN("glXSwapBuffers");
+      const Clock::time_point swap_start = Clock::now();
+      glXSwapBuffers(gl_win_->dpy, gl_win_->win);
+      last_swap_ms_ = Milliseconds(Clock::now() - swap_start);
+    }
+    if (max_fps_ > 0.0) {
+      // Wait out the rest of the frame after the swap, rather than before
+      // the events, so that the next frame shows the freshest input.  After
+      // falling behind, start over from now instead of catching up.
+      TRACE_SPAN("FrameLimit");
+      const Clock::time_point wait_start = Clock::now();
+      next_frame += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / max_fps_));
+      if (next_frame < wait_start) {
+        next_frame = wait_start;
+      }
+      SleepUntil(next_frame);
+      wait_ms += Milliseconds(Clock::now() - wait_start);
+    }
+  }
+}
 
-    Draw();
-    glXSwapBuffers(gl_win_->dpy, gl_win_->win);
+void Window::set_swap_interval(int interval) {
+  swap_interval_ = interval;
+  if (running_ && !ApplySwapInterval()) {
+    std::cout << "Swap interval can not be changed" << std::endl;
+  }
+}
+
+bool Window::ApplySwapInterval() {
+  typedef void (*SwapIntervalEXT)(Display*, GLXDrawable, int);
+  typedef int (*SwapInterval)(unsigned int);
+  const char* extensions =
+      glXQueryExtensionsString(gl_win_->dpy, gl_win_->screen);
+  if (HasExtension(extensions, "GLX_EXT_swap_control")) {
+    SwapIntervalEXT swap_interval = reinterpret_cast<SwapIntervalEXT>(
+        glXGetProcAddress(
+            reinterpret_cast<const GLubyte*>("glXSwapIntervalEXT")));
+    if (swap_interval != nullptr) {
+      swap_interval(gl_win_->dpy, gl_win_->win, swap_interval_);
+      return true;
+    }
+  }
+  if (HasExtension(extensions, "GLX_MESA_swap_control")) {
+    SwapInterval swap_interval = reinterpret_cast<SwapInterval>(
+        glXGetProcAddress(
+            reinterpret_cast<const GLubyte*>("glXSwapIntervalMESA")));
+    if (swap_interval != nullptr) {
+      return swap_interval(swap_interval_) == 0;
+    }
+  }
+  // The SGI version can not turn waiting off.
+  if (swap_interval_ > 0 &&
+      HasExtension(extensions, "GLX_SGI_swap_control")) {
+    SwapInterval swap_interval = reinterpret_cast<SwapInterval>(
+        glXGetProcAddress(
+            reinterpret_cast<const GLubyte*>("glXSwapIntervalSGI")));
+    if (swap_interval != nullptr) {
+      return swap_interval(swap_interval_) == 0;
+    }
+  }
+  return false;
+}
+
+bool Window::WaitForEvents(int timeout_ms) {
+  // XPending also sends anything buffered, which the server may be waiting
+  // for before it sends any events.
+  if (XPending(gl_win_->dpy) > 0) {
+    return true;
+  }
+  pollfd fd;
+  fd.fd = ConnectionNumber(gl_win_->dpy);
+  fd.events = POLLIN;
+  fd.revents = 0;
+  // Xlib calls from other threads can read our events into the queue
+  // without waking this up, which timeout_ms puts a bound on.
+  poll(&fd, 1, timeout_ms > 0 ? timeout_ms : -1);
+  return XPending(gl_win_->dpy) > 0;
+}
+
+void Window::HandleEvents() {
+  TRACE_SPAN("HandleEvents");
+  while (XPending(gl_win_->dpy) > 0) {
+    XEvent event;
+    XNextEvent(gl_win_->dpy, &event);
+    // Any event might change what is drawn, including exposing it.
+    redraw_ = true;
+    switch (event.type) {
+      case ConfigureNotify:
+        if ((static_cast<unsigned int>(event.xconfigure.width) !=
+             gl_win_->width) ||
+            (static_cast<unsigned int>(event.xconfigure.height) !=
+             gl_win_->height)) {
+          gl_win_->width = event.xconfigure.width;
+          gl_win_->height = event.xconfigure.height;
+          Resize(gl_win_->width, gl_win_->height);
+        }
+        break;
+      case ClientMessage:
+        if (*XGetAtomName(gl_win_->dpy, event.xclient.message_type) ==
+            *"WM_PROTOCOLS") {
+          running_ = false;
+        }
+        break;
+      case KeyPress:
+        KeySym keysym;
+        XLookupString(&event.xkey, nullptr, 0, &keysym, nullptr);
+        Keypress(keysym);
+        break;
+    }
   }
 }
 
@@ -183,6 +357,24 @@ void Window::Close() {
   running_ = false;
 }
 
+std::unique_ptr<SharedContext> Window::CreateSharedContext() {
+  GLXContext ctx = glXCreateContext(gl_win_->dpy, gl_win_->vi, gl_win_->ctx,
+                                    GL_TRUE);
+  if (ctx == nullptr) {
+    return nullptr;
+  }
+  XSetWindowAttributes attr;
+  attr.colormap = gl_win_->attr.colormap;
+  attr.border_pixel = 0;
+  ::Window win = XCreateWindow(gl_win_->dpy,
+                               RootWindow(gl_win_->dpy, gl_win_->vi->screen),
+                               0, 0, 1, 1, 0, gl_win_->vi->depth, InputOutput,
+                               gl_win_->vi->visual, CWBorderPixel | CWColormap,
+                               &attr);
+  return std::unique_ptr<SharedContext>(
+      new GLXSharedContext(gl_win_->dpy, win, ctx));
+}
+
 int Window::width() const {
   return gl_win_->width;
 }
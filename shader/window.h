@@ -5,6 +5,12 @@
 //   Resize(): called after a resize event (easiest to use defaults)
 //   Keypress(): called whenever a key is _pressed_ (not released)
 //   Draw(): called after handling all events
+//   Animating(): whether frames change without any events (default: always)
+//   Idle(): called now and then while the loop is waiting for events
+//
+// Frames are drawn only while Animating() returns true, or after an event or
+// a call to Redraw().  Otherwise the loop sleeps on the X connection until
+// something happens, using no cpu.
 // 
 // The classes provided in this file are:
 // Window - A bare bones abstract class that handles an event loop.
@@ -28,6 +34,17 @@ namespace graphics {
 
 struct GLWindow;
 
+// A GL context that shares objects, such as programs, with a window's, for
+// creating them on another thread.
+class SharedContext {
+ public:
+  virtual ~SharedContext() {}
+
+  // Make the context current on the calling thread, or release it if
+  // current is false.  Returns whether that succeeded.
+  virtual bool MakeCurrent(bool current) = 0;
+};
+
 class Window {
  public:
   // Create a new window with the given width and height in pixels, and
@@ -41,6 +58,20 @@ class Window {
   // window is closed externally.
   void Run();
 
+  // Wait for interval vertical blanks before showing each frame, or not at
+  // all for 0, where the driver supports changing it.  Call from the
+  // window's thread.
+  void set_swap_interval(int interval);
+
+  // Draw at most fps frames per second, or as many as possible for 0.
+  void set_max_fps(double fps) { max_fps_ = fps; }
+
+  // While waiting for events, call Idle() at least every interval_ms
+  // milliseconds, or never for 0.
+  void set_idle_interval_ms(int interval_ms) {
+    idle_interval_ms_ = interval_ms;
+  }
+
  protected:
   // For initializing any application state or OpenGL stuff.
   virtual bool Init();
@@ -54,17 +85,58 @@ class Window {
   // Handle redrawing the frame.
   virtual void Draw() = 0;
 
+  // Whether the next frame would differ from the last even without any
+  // events, so that Run should keep drawing.
+  virtual bool Animating() { return true; }
+
+  // Do any periodic work while no frames are being drawn, such as checking
+  // for changes that should be shown with Redraw().
+  virtual void Idle() {}
+
+  // Draw another frame, even if not animating.
+  void Redraw() { redraw_ = true; }
+
   // Request that the window is closed, also ends the event loop in Run().
   // Note that depending on where you call this, Draw() may be called 1
   // more time.  Also note that the window may be externally closed.
   void Close();
 
+  // Create a context that shares objects with the window's, or return null
+  // if that is not possible.  Call from Init or later.  The context must
+  // be destroyed before the window.
+  std::unique_ptr<SharedContext> CreateSharedContext();
+
   int width() const;
   int height() const;
+
+  // How long handling the events before the current frame took, and the
+  // swap that showed the frame before, in milliseconds.
+  double last_events_ms() const { return last_events_ms_; }
+  double last_swap_ms() const { return last_swap_ms_; }
+  // How long the loop waited, for events or the frame rate limit, since the
+  // frame before, in milliseconds.
+  double last_wait_ms() const { return last_wait_ms_; }
   
  private:
+  // Handle any pending X events.
+  void HandleEvents();
+
+  // Wait until there are X events, or for at most timeout_ms milliseconds
+  // if it is positive.  Returns whether there are events.
+  bool WaitForEvents(int timeout_ms);
+
+  // Apply swap_interval_ to the window, if it was set.
+  bool ApplySwapInterval();
+
   std::unique_ptr<GLWindow> gl_win_;
   bool running_;
+  bool redraw_;
+  int swap_interval_;
+  double max_fps_;
+  int idle_interval_ms_;
+  double last_events_ms_;
+  double last_swap_ms_;
+  double last_wait_ms_;
 };
 
 class Window2d : public Window {